@@ -1,9 +1,12 @@
 #include "include/ast.h"
+#include "include/mem.h"
+#include "include/resolver.h"
+#include "include/writer.h"
 #include <stdio.h>
 
 AST_t *ast_create(AST_Type type) {
 
-  AST_t *ast = calloc(1, sizeof(AST_t));
+  AST_t *ast = mem_alloc(MEM_AST, sizeof(AST_t));
 
   ast->type = type;
 
@@ -14,79 +17,397 @@ AST_t *ast_create(AST_Type type) {
   return ast;
 }
 
-// Function to pretty print an AST node and its children
-void pretty_print_ast(AST_t *node, int indent) {
+/*****************************************************************************/
+/*                               Tree traversal                              */
+/*****************************************************************************/
+
+typedef struct VisitFrame {
+  AST_t *node;
+  size_t depth;
+  bool entered; // pre has run and the children are above it on the stack
+} VisitFrame;
+
+typedef struct VisitStack {
+  VisitFrame *frames;
+  size_t size;
+  size_t capacity;
+} VisitStack;
+
+static void visit_push(VisitStack *stack, AST_t *node, size_t depth) {
 
   if (node == NULL) {
     return;
   }
 
-  for (int i = 0; i < indent; i++) {
-    printf("  "); // Print two spaces for each level of indentation
+  if (stack->size == stack->capacity) {
+    size_t capacity = (stack->capacity < 64) ? 64 : stack->capacity * 2;
+    stack->frames =
+        mem_realloc(MEM_MISC, stack->frames,
+                    stack->capacity * sizeof(VisitFrame),
+                    capacity * sizeof(VisitFrame));
+    stack->capacity = capacity;
+  }
+
+  stack->frames[stack->size++] = (VisitFrame){node, depth, false};
+}
+
+static void visit_push_array(VisitStack *stack, array_T *nodes,
+                             size_t depth) {
+
+  if (nodes == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < nodes->size; i++) {
+    visit_push(stack, nodes->items[i], depth);
   }
+}
+
+/* Pushes every child of node so that the first child ends up on top */
+static void visit_push_children(VisitStack *stack, AST_t *node,
+                                size_t depth) {
+
+  size_t first = stack->size;
 
   switch (node->type) {
-  case AST_PROGRAM:
-    printf("[Program]\n");
+  case AST_FUNC_DECL:
+    visit_push_array(stack, node->func_decl.children, depth);
     break;
-  case AST_CLASS_DECL:
-    printf("[Class] Name: `%s`, has_body: `%d`\n", node->class_decl.name->str,
-           node->class_decl.has_body);
+  case AST_PRINT_STMT:
+    visit_push_array(stack, node->print_stmt.print_targets, depth);
+    break;
+  case AST_VAR:
+    visit_push(stack, node->var_decl.value, depth);
+    break;
+  case AST_STATEMENT:
+    visit_push(stack, node->expr_stmt.expr, depth);
+    break;
+  case AST_IF_STMT:
+    visit_push(stack, node->if_stmt.condition, depth);
+    visit_push(stack, node->if_stmt.then_branch, depth);
+    visit_push(stack, node->if_stmt.else_branch, depth);
+    break;
+  case AST_RETURN_STMT:
+    visit_push(stack, node->return_stmt.value, depth);
+    break;
+  case AST_BINARY:
+    visit_push(stack, node->binary.left, depth);
+    visit_push(stack, node->binary.right, depth);
+    break;
+  case AST_UNARY:
+    visit_push(stack, node->unary.right, depth);
+    break;
+  case AST_CALL:
+    visit_push(stack, node->call.callee, depth);
+    visit_push_array(stack, node->call.args, depth);
     break;
-  case AST_FUNC_DECL: {
-    printf("[Function] Name: `%s`, has_body: `%d`\n", node->func_decl.name->str,
-           node->func_decl.has_body);
+  case AST_GET:
+    visit_push(stack, node->get.object, depth);
+    break;
+  default:
+    break;
+  }
 
-    if (node->func_decl.args != NULL) {
-      for (size_t i = 0; i < node->func_decl.args->size; i++) {
+  visit_push_array(stack, node->children, depth);
 
-        for (int i = 0; i < indent + 1; i++) {
-          printf("  "); // Print two spaces for each level of indentation
-        }
-        Token *arg = (Token *)node->func_decl.args->items[i];
-        printf("[Argument %zu]: %s \n", i, arg->str);
+  // Pushed in source order, so reverse them to pop in source order
+  for (size_t i = first, j = stack->size; i + 1 < j; i++, j--) {
+    VisitFrame tmp = stack->frames[i];
+    stack->frames[i] = stack->frames[j - 1];
+    stack->frames[j - 1] = tmp;
+  }
+}
+
+void ast_visit(AST_t *root, AST_VisitFn pre, AST_VisitFn post, void *ctx) {
+
+  VisitStack stack = {0};
+  visit_push(&stack, root, 0);
+
+  while (stack.size > 0) {
+    VisitFrame *frame = &stack.frames[stack.size - 1];
+
+    if (!frame->entered) {
+      frame->entered = true;
+
+      AST_VisitResult result = (pre != NULL)
+                                   ? pre(frame->node, frame->depth, ctx)
+                                   : AST_VISIT_CONTINUE;
+      if (result == AST_VISIT_STOP) {
+        break;
       }
+      if (result == AST_VISIT_CONTINUE) {
+        // Pushing may move the frames, so frame is stale after this
+        visit_push_children(&stack, frame->node, frame->depth + 1);
+      }
+      continue;
+    }
+
+    stack.size--;
+    if (post != NULL &&
+        post(frame->node, frame->depth, ctx) == AST_VISIT_STOP) {
+      break;
     }
+  }
+
+  mem_free(MEM_MISC, stack.frames, stack.capacity * sizeof(VisitFrame));
+}
 
-    if (node->func_decl.has_body) {
-      for (size_t i = 0; i < node->func_decl.children->size; i++) {
+static AST_VisitResult destroy_pre(AST_t *node, size_t depth, void *keep) {
+  (void)depth;
+  return (node == keep) ? AST_VISIT_SKIP : AST_VISIT_CONTINUE;
+}
+
+/* Frees one node once its children are gone */
+static AST_VisitResult destroy_post(AST_t *node, size_t depth, void *keep) {
+  (void)depth;
+
+  if (node == keep) {
+    return AST_VISIT_CONTINUE;
+  }
 
-        for (int i = 0; i < indent; i++) {
-          printf("  "); // Print two spaces for each level of indentation
-        }
-        AST_t *funcBody = (AST_t *)node->func_decl.children->items[i];
-        pretty_print_ast(funcBody, indent);
+  switch (node->type) {
+  case AST_FUNC_DECL:
+    array_destroy(node->func_decl.args);
+    array_destroy(node->func_decl.children);
+    if (node->func_decl.locals != NULL) {
+      for (size_t i = 0; i < node->func_decl.locals->size; i++) {
+        mem_free(MEM_RESOLVER, node->func_decl.locals->items[i],
+                 sizeof(Local));
       }
+      array_destroy(node->func_decl.locals);
     }
-
+    if (node->func_decl.upvalues != NULL) {
+      for (size_t i = 0; i < node->func_decl.upvalues->size; i++) {
+        mem_free(MEM_RESOLVER, node->func_decl.upvalues->items[i],
+                 sizeof(Upvalue));
+      }
+      array_destroy(node->func_decl.upvalues);
+    }
+    break;
+  case AST_PRINT_STMT:
+    array_destroy(node->print_stmt.print_targets);
+    break;
+  case AST_CALL:
+    array_destroy(node->call.args);
+    break;
+  default:
     break;
   }
 
+  array_destroy(node->children);
+
+  if (node->owned_token != NULL) {
+    token_destroy(node->owned_token);
+  }
+
+  mem_free(MEM_AST, node, sizeof(AST_t));
+  return AST_VISIT_CONTINUE;
+}
+
+// Frees the tree rooted at node, leaving the subtree at keep (if any) alone.
+// Tokens belong to the lexer unless a pass made them (owned_token).
+void ast_destroy_except(AST_t *node, AST_t *keep) {
+  ast_visit(node, destroy_pre, destroy_post, keep);
+}
+
+void ast_destroy(AST_t *node) { ast_destroy_except(node, NULL); }
+
+static bool ast_token_equal(Token *a, Token *b) {
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+  return token_equal(a, b);
+}
+
+/* Compares two arrays of nodes, or of tokens if of_tokens is set */
+static bool ast_array_equal(array_T *a, array_T *b, bool of_tokens) {
+  size_t a_size = (a != NULL) ? a->size : 0;
+  size_t b_size = (b != NULL) ? b->size : 0;
+
+  if ((a == NULL) != (b == NULL) || a_size != b_size) {
+    return false;
+  }
+
+  for (size_t i = 0; i < a_size; i++) {
+    bool equal = of_tokens ? ast_token_equal(a->items[i], b->items[i])
+                           : ast_equal(a->items[i], b->items[i]);
+    if (!equal) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Returns true if both trees have the same shape and tokens, ignoring
+// anything later passes attach
+bool ast_equal(AST_t *a, AST_t *b) {
+
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+
+  if (a->type != b->type || a->token_start != b->token_start ||
+      a->token_end != b->token_end ||
+      !ast_array_equal(a->children, b->children, false)) {
+    return false;
+  }
+
+  switch (a->type) {
+  case AST_CLASS_DECL:
+    return ast_token_equal(a->class_decl.name, b->class_decl.name) &&
+           a->class_decl.has_body == b->class_decl.has_body;
+  case AST_FUNC_DECL:
+    return ast_token_equal(a->func_decl.name, b->func_decl.name) &&
+           a->func_decl.has_body == b->func_decl.has_body &&
+           a->func_decl.is_lazy == b->func_decl.is_lazy &&
+           ast_array_equal(a->func_decl.args, b->func_decl.args, true) &&
+           ast_array_equal(a->func_decl.children, b->func_decl.children,
+                           false);
+  case AST_VAR:
+    return ast_token_equal(a->var_decl.name, b->var_decl.name) &&
+           ast_equal(a->var_decl.value, b->var_decl.value);
+  case AST_PRINT_STMT:
+    return ast_array_equal(a->print_stmt.print_targets,
+                           b->print_stmt.print_targets, false);
   case AST_STRING_LIT:
-    printf("[String literal] `%s`\n", node->str_literal.str->str);
-    break;
+    return ast_token_equal(a->str_literal.str, b->str_literal.str);
   case AST_INT_LIT:
-    printf("[Int literal] `%s`\n", node->str_literal.str->str);
+    return ast_token_equal(a->int_literal.num, b->int_literal.num);
+  case AST_STATEMENT:
+    return ast_equal(a->expr_stmt.expr, b->expr_stmt.expr);
+  case AST_IF_STMT:
+    return ast_equal(a->if_stmt.condition, b->if_stmt.condition) &&
+           ast_equal(a->if_stmt.then_branch, b->if_stmt.then_branch) &&
+           ast_equal(a->if_stmt.else_branch, b->if_stmt.else_branch);
+  case AST_RETURN_STMT:
+    return ast_token_equal(a->return_stmt.keyword, b->return_stmt.keyword) &&
+           ast_equal(a->return_stmt.value, b->return_stmt.value);
+  case AST_BINARY:
+    return ast_token_equal(a->binary.op, b->binary.op) &&
+           ast_equal(a->binary.left, b->binary.left) &&
+           ast_equal(a->binary.right, b->binary.right);
+  case AST_UNARY:
+    return ast_token_equal(a->unary.op, b->unary.op) &&
+           ast_equal(a->unary.right, b->unary.right);
+  case AST_CALL:
+    return ast_token_equal(a->call.paren, b->call.paren) &&
+           ast_equal(a->call.callee, b->call.callee) &&
+           ast_array_equal(a->call.args, b->call.args, false);
+  case AST_GET:
+    return ast_token_equal(a->get.name, b->get.name) &&
+           ast_equal(a->get.object, b->get.object);
+  case AST_PRIMARY:
+    return ast_token_equal(a->primary.value, b->primary.value);
+  default:
+    return true;
+  }
+}
+
+static AST_VisitResult count_pre(AST_t *node, size_t depth, void *count) {
+  (void)node;
+  (void)depth;
+  (*(size_t *)count)++;
+  return AST_VISIT_CONTINUE;
+}
+
+// Returns the number of nodes in the tree rooted at node
+size_t ast_count_nodes(AST_t *node) {
+  size_t count = 0;
+  ast_visit(node, count_pre, NULL, &count);
+  return count;
+}
+
+typedef struct PrintContext {
+  Writer writer;
+  size_t indent; // Levels to add to every line
+} PrintContext;
+
+static AST_VisitResult print_pre(AST_t *node, size_t depth, void *ctx) {
+
+  PrintContext *print = ctx;
+  Writer *w = &print->writer;
+
+  writer_indent(w, print->indent + depth);
+
+  switch (node->type) {
+  case AST_PROGRAM:
+    writer_puts(w, "[Program]\n");
     break;
-  case AST_PRINT_STMT:
-    printf("[Print statement] \n");
+  case AST_CLASS_DECL:
+    writer_printf(w, "[Class] Name: `%s`, has_body: `%d`\n",
+                  node->class_decl.name->str, node->class_decl.has_body);
+    break;
+  case AST_FUNC_DECL:
+    writer_printf(w, "[Function] Name: `%s`, has_body: `%d`%s\n",
+                  node->func_decl.name->str, node->func_decl.has_body,
+                  node->func_decl.is_lazy ? " (body not parsed)" : "");
 
-    if (node->print_stmt.print_targets != NULL) {
-      for (size_t i = 0; i < node->print_stmt.print_targets->size; i++) {
-        // print out the targets...
+    if (node->func_decl.args != NULL) {
+      for (size_t i = 0; i < node->func_decl.args->size; i++) {
+        Token *arg = (Token *)node->func_decl.args->items[i];
+        writer_indent(w, print->indent + depth + 1);
+        writer_printf(w, "[Argument %zu]: %s \n", i, arg->str);
       }
     }
     break;
+  case AST_STRING_LIT:
+    writer_printf(w, "[String literal] `%s`\n", node->str_literal.str->str);
+    break;
+  case AST_INT_LIT:
+    writer_printf(w, "[Int literal] `%s`\n", node->str_literal.str->str);
+    break;
+  case AST_PRINT_STMT:
+    writer_puts(w, "[Print statement] \n");
+    break;
+  case AST_VAR:
+    writer_printf(w, "[Var] Name: `%s`\n", node->var_decl.name->str);
+    break;
+  case AST_STATEMENT:
+    writer_puts(w, "[Statement]\n");
+    break;
+  case AST_BLOCK:
+    writer_puts(w, "[Block]\n");
+    break;
+  case AST_IF_STMT:
+    writer_puts(w, "[If statement]\n");
+    break;
+  case AST_RETURN_STMT:
+    writer_puts(w, "[Return statement]\n");
+    break;
+  case AST_BINARY:
+    writer_printf(w, "[Binary] Operator: `%s`\n", node->binary.op->str);
+    break;
+  case AST_UNARY:
+    writer_printf(w, "[Unary] Operator: `%s`\n", node->unary.op->str);
+    break;
+  case AST_CALL:
+    writer_printf(w, "[Call] is_tail: `%d`\n", node->call.is_tail);
+    break;
+  case AST_GET:
+    writer_printf(w, "[Get] Name: `%s`\n", node->get.name->str);
+    break;
+  case AST_PRIMARY:
+    writer_printf(w, "[Primary] `%s`\n", node->primary.value->str);
+    break;
   default:
-    printf("[OTHER] Type: `%d`\n", node->type);
+    writer_printf(w, "[OTHER] Type: `%d`\n", node->type);
     break;
   }
 
-  /* Recursively print children */
-  if (node->children != NULL) {
-    for (size_t i = 0; i < node->children->size; i++) {
-      pretty_print_ast(node->children->items[i],
-                       indent + 1); // Increment indent for child nodes
-    }
-  }
+  return AST_VISIT_CONTINUE;
+}
+
+// Pretty prints an AST node and its children to stdout, indented by depth
+void pretty_print_ast(AST_t *node, int depth) {
+
+  // Big enough that it should not live on the stack
+  PrintContext *print = mem_alloc(MEM_MISC, sizeof(PrintContext));
+  writer_init(&print->writer, stdout);
+  print->indent = (depth > 0) ? depth : 0;
+
+  ast_visit(node, print_pre, NULL, print);
+
+  writer_flush(&print->writer);
+  mem_free(MEM_MISC, print, sizeof(PrintContext));
 }
@@ -0,0 +1,773 @@
+#define _POSIX_C_SOURCE 200809L
+#include "include/cache.h"
+#include "include/mem.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+/*                                  Writing                                  */
+/*****************************************************************************/
+
+/* A growable byte buffer for one table */
+typedef struct Buffer {
+  char *data;
+  size_t size;
+  size_t capacity;
+} Buffer;
+
+static size_t buffer_append(Buffer *buf, const void *bytes, size_t len) {
+  if (len == 0) {
+    return buf->size;
+  }
+
+  if (buf->size + len > buf->capacity) {
+    size_t capacity = buf->capacity < 256 ? 256 : buf->capacity;
+    while (capacity < buf->size + len) {
+      capacity *= 2;
+    }
+    buf->data = mem_realloc(MEM_MISC, buf->data, buf->capacity, capacity);
+    buf->capacity = capacity;
+  }
+
+  size_t at = buf->size;
+  memcpy(buf->data + at, bytes, len);
+  buf->size += len;
+  return at;
+}
+
+static void buffer_free(Buffer *buf) {
+  mem_free(MEM_MISC, buf->data, buf->capacity);
+}
+
+/* A node still to be written, and where its index goes once it is */
+typedef struct WriteFrame {
+  AST_t *node;
+  Buffer *table; // The node or reference table
+  size_t at;     // Byte offset of the index in table
+} WriteFrame;
+
+typedef struct CacheWriter {
+  array_T *tokens; // The lexer's tokens, for turning pointers into indices
+  Buffer token_table;
+  Buffer node_table;
+  Buffer ref_table;
+  Buffer string_table;
+  WriteFrame *frames; // Nodes waiting to be written
+  size_t size;
+  size_t capacity;
+} CacheWriter;
+
+/* Index of a token in the lexer's list, found by its offset */
+static uint32_t token_index(CacheWriter *w, Token *token) {
+  if (token == NULL) {
+    return CACHE_NONE;
+  }
+
+  size_t lo = 0;
+  size_t hi = w->tokens->size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (((Token *)w->tokens->items[mid])->offset < token->offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  assert(lo < w->tokens->size && w->tokens->items[lo] == token &&
+         "Only tokens from the lexer can be cached");
+  return (uint32_t)lo;
+}
+
+/* Queues node to be written, its index to be stored at offset at of table.
+   The slot keeps CACHE_NONE until then. */
+static void write_node(CacheWriter *w, AST_t *node, Buffer *table, size_t at) {
+  if (node == NULL) {
+    return;
+  }
+
+  if (w->size == w->capacity) {
+    size_t capacity = (w->capacity < 64) ? 64 : w->capacity * 2;
+    w->frames = mem_realloc(MEM_MISC, w->frames,
+                            w->capacity * sizeof(WriteFrame),
+                            capacity * sizeof(WriteFrame));
+    w->capacity = capacity;
+  }
+
+  w->frames[w->size++] = (WriteFrame){node, table, at};
+}
+
+/* Queues node to fill field i of the record at index */
+static void write_field(CacheWriter *w, AST_t *node, uint32_t index, int i) {
+  write_node(w, node, &w->node_table,
+             index * sizeof(CacheNode) + offsetof(CacheNode, field) +
+                 i * sizeof(uint32_t));
+}
+
+/* Reserves a run of references for nodes, which are written later */
+static CacheArray write_nodes(CacheWriter *w, array_T *nodes) {
+  CacheArray array = {0, CACHE_NONE};
+  if (nodes == NULL) {
+    return array;
+  }
+
+  array.first = (uint32_t)(w->ref_table.size / sizeof(uint32_t));
+  array.count = (uint32_t)nodes->size;
+  for (size_t i = 0; i < nodes->size; i++) {
+    uint32_t none = CACHE_NONE;
+    size_t at = buffer_append(&w->ref_table, &none, sizeof(none));
+    write_node(w, nodes->items[i], &w->ref_table, at);
+  }
+
+  return array;
+}
+
+static CacheArray write_tokens(CacheWriter *w, array_T *tokens) {
+  CacheArray array = {0, CACHE_NONE};
+  if (tokens == NULL) {
+    return array;
+  }
+
+  array.first = (uint32_t)(w->ref_table.size / sizeof(uint32_t));
+  array.count = (uint32_t)tokens->size;
+  for (size_t i = 0; i < tokens->size; i++) {
+    uint32_t index = token_index(w, tokens->items[i]);
+    buffer_append(&w->ref_table, &index, sizeof(index));
+  }
+
+  return array;
+}
+
+/* Writes the record of one queued node, queueing the nodes under it */
+static void write_frame(CacheWriter *w, WriteFrame frame) {
+  AST_t *node = frame.node;
+  assert(node->owned_token == NULL && "Cache the tree before optimising it");
+
+  CacheNode out = {0};
+  uint32_t index = (uint32_t)(w->node_table.size / sizeof(CacheNode));
+
+  out.type = node->type;
+  out.token_start = (uint32_t)node->token_start;
+  out.token_end = (uint32_t)node->token_end;
+  for (int i = 0; i < 4; i++) {
+    out.field[i] = CACHE_NONE;
+  }
+  out.list[0].count = CACHE_NONE;
+  out.list[1].count = CACHE_NONE;
+  buffer_append(&w->node_table, &out, sizeof(out)); // Filled in below
+
+  out.children = write_nodes(w, node->children);
+
+  switch (node->type) {
+  case AST_CLASS_DECL:
+    out.field[0] = token_index(w, node->class_decl.name);
+    out.flags = node->class_decl.has_body;
+    break;
+  case AST_FUNC_DECL:
+    out.field[0] = token_index(w, node->func_decl.name);
+    out.field[1] = (uint32_t)node->func_decl.body_start;
+    out.flags = node->func_decl.has_body | node->func_decl.is_lazy << 1;
+    out.list[0] = write_tokens(w, node->func_decl.args);
+    out.list[1] = write_nodes(w, node->func_decl.children);
+    break;
+  case AST_VAR:
+    out.field[0] = token_index(w, node->var_decl.name);
+    write_field(w, node->var_decl.value, index, 1);
+    out.flags = node->var_decl.has_val;
+    break;
+  case AST_PRINT_STMT:
+    out.list[0] = write_nodes(w, node->print_stmt.print_targets);
+    break;
+  case AST_STRING_LIT:
+    out.field[0] = token_index(w, node->str_literal.str);
+    break;
+  case AST_INT_LIT:
+    out.field[0] = token_index(w, node->int_literal.num);
+    break;
+  case AST_STATEMENT:
+    write_field(w, node->expr_stmt.expr, index, 0);
+    break;
+  case AST_IF_STMT:
+    write_field(w, node->if_stmt.condition, index, 0);
+    write_field(w, node->if_stmt.then_branch, index, 1);
+    write_field(w, node->if_stmt.else_branch, index, 2);
+    break;
+  case AST_RETURN_STMT:
+    out.field[0] = token_index(w, node->return_stmt.keyword);
+    write_field(w, node->return_stmt.value, index, 1);
+    break;
+  case AST_BINARY:
+    write_field(w, node->binary.left, index, 0);
+    out.field[1] = token_index(w, node->binary.op);
+    write_field(w, node->binary.right, index, 2);
+    break;
+  case AST_UNARY:
+    out.field[0] = token_index(w, node->unary.op);
+    write_field(w, node->unary.right, index, 1);
+    break;
+  case AST_CALL:
+    write_field(w, node->call.callee, index, 0);
+    out.field[1] = token_index(w, node->call.paren);
+    out.list[0] = write_nodes(w, node->call.args);
+    out.flags = node->call.is_tail;
+    break;
+  case AST_GET:
+    write_field(w, node->get.object, index, 0);
+    out.field[1] = token_index(w, node->get.name);
+    break;
+  case AST_PRIMARY:
+    out.field[0] = token_index(w, node->primary.value);
+    break;
+  default:
+    break;
+  }
+
+  memcpy(w->node_table.data + index * sizeof(CacheNode), &out, sizeof(out));
+  memcpy(frame.table->data + frame.at, &index, sizeof(index));
+}
+
+/* Writes the tree under root without recursing, so a deep tree can't run out
+   of stack. Nodes are written before anything they refer to, which is what
+   the reader checks for. */
+static uint32_t write_tree(CacheWriter *w, AST_t *root) {
+  Buffer root_slot = {0};
+  uint32_t root_index = CACHE_NONE;
+  buffer_append(&root_slot, &root_index, sizeof(root_index));
+  write_node(w, root, &root_slot, 0);
+
+  while (w->size > 0) {
+    write_frame(w, w->frames[--w->size]);
+  }
+
+  memcpy(&root_index, root_slot.data, sizeof(root_index));
+  buffer_free(&root_slot);
+  mem_free(MEM_MISC, w->frames, w->capacity * sizeof(WriteFrame));
+  w->frames = NULL;
+  w->capacity = 0;
+  return root_index;
+}
+
+static bool write_table(FILE *fp, Buffer *table) {
+  return table->size == 0 || fwrite(table->data, table->size, 1, fp) == 1;
+}
+
+bool cache_write(const char *path, uint64_t source_hash, size_t source_len,
+                 uint32_t flags, uint32_t lazy_bodies, array_T *tokens,
+                 AST_t *program) {
+  CacheWriter w = {0};
+  w.tokens = tokens;
+
+  for (size_t i = 0; i < tokens->size; i++) {
+    Token *token = tokens->items[i];
+    CacheToken out = {token->type, (uint32_t)token->offset,
+                      (uint32_t)token->pos.line, (uint32_t)token->pos.x,
+                      (uint32_t)token->len, 0};
+    out.str = (uint32_t)buffer_append(&w.string_table, token->str,
+                                      token->len + 1);
+    buffer_append(&w.token_table, &out, sizeof(out));
+  }
+
+  uint32_t root = write_tree(&w, program);
+
+  CacheHeader header = {0};
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.source_hash = source_hash;
+  header.source_len = source_len;
+  header.flags = flags;
+  header.lazy_bodies = lazy_bodies;
+  header.token_count = (uint32_t)tokens->size;
+  header.node_count = (uint32_t)(w.node_table.size / sizeof(CacheNode));
+  header.ref_count = (uint32_t)(w.ref_table.size / sizeof(uint32_t));
+  header.string_size = (uint32_t)w.string_table.size;
+  header.root = root;
+  header.tokens_offset = sizeof(CacheHeader);
+  header.nodes_offset = header.tokens_offset + (uint32_t)w.token_table.size;
+  header.refs_offset = header.nodes_offset + (uint32_t)w.node_table.size;
+  header.strings_offset = header.refs_offset + (uint32_t)w.ref_table.size;
+
+  uint64_t checksum = hash_fnv1a((const char *)&header, sizeof(header));
+  checksum =
+      hash_fnv1a_update(checksum, w.token_table.data, w.token_table.size);
+  checksum = hash_fnv1a_update(checksum, w.node_table.data, w.node_table.size);
+  checksum = hash_fnv1a_update(checksum, w.ref_table.data, w.ref_table.size);
+  checksum = hash_fnv1a_update(checksum, w.string_table.data,
+                               w.string_table.size);
+  header.checksum = checksum;
+
+  // Write next to the real file and rename over it, so nobody reading the
+  // cache sees half a file
+  size_t tmp_len = strlen(path) + 5;
+  char *tmp = mem_alloc(MEM_MISC, tmp_len);
+  snprintf(tmp, tmp_len, "%s.tmp", path);
+
+  bool ok = false;
+  FILE *fp = fopen(tmp, "wb");
+  if (fp != NULL) {
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         write_table(fp, &w.token_table) && write_table(fp, &w.node_table) &&
+         write_table(fp, &w.ref_table) && write_table(fp, &w.string_table);
+    ok = (fclose(fp) == 0) && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+      remove(tmp);
+    }
+  }
+
+  if (!ok) {
+    PRINT_ERROR("Could not write cache file `%s`", path);
+  }
+
+  mem_free(MEM_MISC, tmp, tmp_len);
+  buffer_free(&w.token_table);
+  buffer_free(&w.node_table);
+  buffer_free(&w.ref_table);
+  buffer_free(&w.string_table);
+  return ok;
+}
+
+/*****************************************************************************/
+/*                                  Reading                                  */
+/*****************************************************************************/
+
+/* True if a table of count entries of size bytes at offset fits in the file */
+static bool table_fits(uint64_t offset, uint64_t count, uint64_t size,
+                       uint64_t file_size) {
+  return offset <= file_size && count * size <= file_size - offset;
+}
+
+/* Maps path read-only. Unlike file_map_read the contents are not hashed or
+   '\0' terminated, and anything too small to hold a header is refused before
+   it is mapped. */
+static File_t *cache_map(char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+      (uint64_t)st.st_size < sizeof(CacheHeader) ||
+      (uint64_t)st.st_size > SIZE_MAX) {
+    PRINT_TRACE("Cache `%s` is too small or not a file", path);
+    close(fd);
+    return NULL;
+  }
+
+  void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    PRINT_TRACE("Could not map cache `%s`", path);
+    return NULL;
+  }
+
+  File_t *file = mem_alloc(MEM_MISC, sizeof(File_t));
+  file->file_size = st.st_size;
+  file->file_contents = mapped;
+  file->mapped = true;
+  file->hash = 0;
+  return file;
+}
+
+bool cache_view_open(CacheView *view, char *path, uint64_t source_hash,
+                     size_t source_len, uint32_t flags) {
+  memset(view, 0, sizeof(*view));
+
+  File_t *file = cache_map(path);
+  if (file == NULL) {
+    return false;
+  }
+
+  const CacheHeader *header = (const CacheHeader *)file->file_contents;
+  uint64_t size = file->file_size;
+
+  bool ok = header->magic == CACHE_MAGIC &&
+            header->version == CACHE_VERSION &&
+            header->source_hash == source_hash &&
+            header->source_len == source_len && header->flags == flags &&
+            table_fits(header->tokens_offset, header->token_count,
+                       sizeof(CacheToken), size) &&
+            table_fits(header->nodes_offset, header->node_count,
+                       sizeof(CacheNode), size) &&
+            table_fits(header->refs_offset, header->ref_count,
+                       sizeof(uint32_t), size) &&
+            table_fits(header->strings_offset, header->string_size, 1, size) &&
+            header->tokens_offset % sizeof(uint32_t) == 0 &&
+            header->nodes_offset % sizeof(uint32_t) == 0 &&
+            header->refs_offset % sizeof(uint32_t) == 0;
+
+  if (!ok) {
+    PRINT_TRACE("Cache `%s` is stale or not a cache file", path);
+    file_unmap(file);
+    return false;
+  }
+
+  // Every table is in the file now, so whatever is in them can be hashed.
+  // The header is hashed too, as it was written: with no checksum yet.
+  const char *base = file->file_contents;
+  CacheHeader unsummed = *header;
+  unsummed.checksum = 0;
+  uint64_t checksum = hash_fnv1a((const char *)&unsummed, sizeof(unsummed));
+  checksum =
+      hash_fnv1a_update(checksum, base + header->tokens_offset,
+                        (size_t)header->token_count * sizeof(CacheToken));
+  checksum = hash_fnv1a_update(checksum, base + header->nodes_offset,
+                               (size_t)header->node_count * sizeof(CacheNode));
+  checksum = hash_fnv1a_update(checksum, base + header->refs_offset,
+                               (size_t)header->ref_count * sizeof(uint32_t));
+  checksum = hash_fnv1a_update(checksum, base + header->strings_offset,
+                               header->string_size);
+  if (checksum != header->checksum) {
+    PRINT_TRACE("Cache `%s` does not match its checksum", path);
+    file_unmap(file);
+    return false;
+  }
+
+  view->file = file;
+  view->header = header;
+  view->tokens =
+      (const CacheToken *)(file->file_contents + header->tokens_offset);
+  view->nodes = (const CacheNode *)(file->file_contents + header->nodes_offset);
+  view->refs = (const uint32_t *)(file->file_contents + header->refs_offset);
+  view->strings = file->file_contents + header->strings_offset;
+
+  return true;
+}
+
+void cache_view_close(CacheView *view) {
+  file_unmap(view->file);
+  memset(view, 0, sizeof(*view));
+}
+
+/* What a node is allowed to be, from where the parser would have put it */
+typedef enum LoadKind {
+  LOAD_PROGRAM, // The root
+  LOAD_DECL,    // A declaration or statement
+  LOAD_METHOD,  // A function in a class
+  LOAD_EXPR,    // An expression
+} LoadKind;
+
+/* A node still to be loaded, and where to put it once it is */
+typedef struct LoadFrame {
+  uint32_t index;
+  uint32_t parent; // Index of the node that refers to it
+  LoadKind kind;
+  AST_t **slot;
+} LoadFrame;
+
+/* State for turning a view back into tokens and nodes. Anything out of range
+   clears ok rather than being trusted. */
+typedef struct CacheLoader {
+  CacheView *view;
+  Token **tokens;
+  LoadFrame *frames; // Nodes waiting to be loaded
+  size_t size;
+  size_t capacity;
+  size_t loaded; // Nodes made so far, never more than the file holds
+  bool ok;
+} CacheLoader;
+
+static Token *load_token(CacheLoader *l, uint32_t index) {
+  if (index == CACHE_NONE) {
+    return NULL;
+  }
+  if (index >= l->view->header->token_count) {
+    l->ok = false;
+    return NULL;
+  }
+  return l->tokens[index];
+}
+
+/* Like load_token, for tokens every node of its type has */
+static Token *need_token(CacheLoader *l, uint32_t index) {
+  Token *token = load_token(l, index);
+  if (token == NULL) {
+    l->ok = false;
+  }
+  return token;
+}
+
+static const uint32_t *load_refs(CacheLoader *l, CacheArray array) {
+  if ((uint64_t)array.first + array.count > l->view->header->ref_count) {
+    l->ok = false;
+    return NULL;
+  }
+  return l->view->refs + array.first;
+}
+
+/* Queues node index to be loaded into slot, which stays NULL until it is */
+static void load_node(CacheLoader *l, uint32_t index, uint32_t parent,
+                      LoadKind kind, AST_t **slot) {
+  *slot = NULL;
+  if (index == CACHE_NONE) {
+    return;
+  }
+
+  if (l->size == l->capacity) {
+    size_t capacity = (l->capacity < 64) ? 64 : l->capacity * 2;
+    l->frames = mem_realloc(MEM_MISC, l->frames,
+                            l->capacity * sizeof(LoadFrame),
+                            capacity * sizeof(LoadFrame));
+    l->capacity = capacity;
+  }
+
+  l->frames[l->size++] = (LoadFrame){index, parent, kind, slot};
+}
+
+/* Like load_node, for nodes the parser always makes */
+static void need_node(CacheLoader *l, uint32_t index, uint32_t parent,
+                      LoadKind kind, AST_t **slot) {
+  if (index == CACHE_NONE) {
+    l->ok = false;
+  }
+  load_node(l, index, parent, kind, slot);
+}
+
+static bool node_fits(LoadKind kind, uint32_t type) {
+  switch (kind) {
+  case LOAD_PROGRAM:
+    return type == AST_PROGRAM;
+  case LOAD_METHOD:
+    return type == AST_FUNC_DECL;
+  case LOAD_DECL:
+    return type == AST_CLASS_DECL || type == AST_FUNC_DECL ||
+           type == AST_VAR || type == AST_PRINT_STMT ||
+           type == AST_RETURN_STMT || type == AST_IF_STMT ||
+           type == AST_BLOCK || type == AST_STATEMENT;
+  case LOAD_EXPR:
+    return type == AST_BINARY || type == AST_UNARY || type == AST_CALL ||
+           type == AST_GET || type == AST_PRIMARY || type == AST_INT_LIT ||
+           type == AST_STRING_LIT;
+  }
+  return false;
+}
+
+static array_T *load_nodes(CacheLoader *l, CacheArray array, uint32_t parent,
+                           LoadKind kind) {
+  if (array.count == CACHE_NONE) {
+    return NULL;
+  }
+
+  const uint32_t *refs = load_refs(l, array);
+  array_T *nodes = array_create(sizeof(AST_t *));
+  if (refs == NULL) {
+    return nodes;
+  }
+
+  // Size the list up front so the slots don't move. They are NULL until the
+  // nodes are loaded, which array_push would not allow.
+  if (array.count > 0) {
+    nodes->items = mem_alloc(MEM_ARRAY, array.count * sizeof(void *));
+    memset(nodes->items, 0, array.count * sizeof(void *));
+    nodes->size = nodes->capacity = array.count;
+  }
+  for (uint32_t i = 0; i < array.count; i++) {
+    need_node(l, refs[i], parent, kind, (AST_t **)&nodes->items[i]);
+  }
+  return nodes;
+}
+
+static array_T *load_tokens(CacheLoader *l, CacheArray array) {
+  if (array.count == CACHE_NONE) {
+    return NULL;
+  }
+
+  const uint32_t *refs = load_refs(l, array);
+  array_T *tokens = array_create(sizeof(Token *));
+  for (uint32_t i = 0; refs != NULL && i < array.count; i++) {
+    array_push(tokens, load_token(l, refs[i]));
+  }
+  return tokens;
+}
+
+/* Makes one queued node, queueing the nodes it refers to */
+static AST_t *load_frame(CacheLoader *l, LoadFrame frame) {
+  const CacheHeader *header = l->view->header;
+  uint32_t index = frame.index;
+
+  // Children always come after their parent, which also rules out cycles. A
+  // node shared by two parents would be loaded twice, so counting them stops
+  // a small file from describing a huge tree.
+  if (index >= header->node_count ||
+      (frame.parent != CACHE_NONE && index <= frame.parent) ||
+      ++l->loaded > header->node_count) {
+    l->ok = false;
+    return NULL;
+  }
+
+  // The passes trust the tree to have the parser's shape, e.g. that a class
+  // only holds functions
+  const CacheNode *in = &l->view->nodes[index];
+  if (!node_fits(frame.kind, in->type) || in->token_start > in->token_end ||
+      in->token_end > header->token_count) {
+    l->ok = false;
+    return NULL;
+  }
+
+  AST_t *node = ast_create(AST_NOTHING); // Not in->type, the union is set here
+  node->type = in->type;
+  node->token_start = in->token_start;
+  node->token_end = in->token_end;
+  node->children = load_nodes(
+      l, in->children, index,
+      (in->type == AST_CLASS_DECL) ? LOAD_METHOD : LOAD_DECL);
+
+  switch (node->type) {
+  case AST_CLASS_DECL:
+    node->class_decl.name = need_token(l, in->field[0]);
+    node->class_decl.has_body = in->flags & 1;
+    break;
+  case AST_FUNC_DECL:
+    node->func_decl.name = need_token(l, in->field[0]);
+    node->func_decl.has_body = in->flags & 1;
+    node->func_decl.is_lazy = (in->flags >> 1) & 1;
+    node->func_decl.args = load_tokens(l, in->list[0]);
+    node->func_decl.children = load_nodes(l, in->list[1], index, LOAD_DECL);
+    // Only a parsed body has a list of declarations. A lazy body is parsed
+    // from body_start later, so that has to be a real token.
+    if (node->func_decl.has_body != (node->func_decl.children != NULL) ||
+        (node->func_decl.has_body && node->func_decl.is_lazy) ||
+        in->field[1] >= header->token_count) {
+      l->ok = false;
+      break;
+    }
+    node->func_decl.body_start = in->field[1];
+    break;
+  case AST_VAR:
+    node->var_decl.name = need_token(l, in->field[0]);
+    node->var_decl.has_val = in->flags & 1;
+    if (node->var_decl.has_val) {
+      need_node(l, in->field[1], index, LOAD_EXPR, &node->var_decl.value);
+    }
+    node->var_decl.slot = -1;
+    break;
+  case AST_PRINT_STMT:
+    node->print_stmt.print_targets =
+        load_nodes(l, in->list[0], index, LOAD_EXPR);
+    break;
+  case AST_STRING_LIT:
+    node->str_literal.str = need_token(l, in->field[0]);
+    break;
+  case AST_INT_LIT:
+    node->int_literal.num = need_token(l, in->field[0]);
+    break;
+  case AST_STATEMENT:
+    load_node(l, in->field[0], index, LOAD_EXPR, &node->expr_stmt.expr);
+    break;
+  case AST_IF_STMT:
+    need_node(l, in->field[0], index, LOAD_EXPR, &node->if_stmt.condition);
+    need_node(l, in->field[1], index, LOAD_DECL, &node->if_stmt.then_branch);
+    load_node(l, in->field[2], index, LOAD_DECL, &node->if_stmt.else_branch);
+    break;
+  case AST_RETURN_STMT:
+    node->return_stmt.keyword = need_token(l, in->field[0]);
+    load_node(l, in->field[1], index, LOAD_EXPR, &node->return_stmt.value);
+    break;
+  case AST_BINARY:
+    need_node(l, in->field[0], index, LOAD_EXPR, &node->binary.left);
+    node->binary.op = need_token(l, in->field[1]);
+    need_node(l, in->field[2], index, LOAD_EXPR, &node->binary.right);
+    break;
+  case AST_UNARY:
+    node->unary.op = need_token(l, in->field[0]);
+    need_node(l, in->field[1], index, LOAD_EXPR, &node->unary.right);
+    break;
+  case AST_CALL:
+    need_node(l, in->field[0], index, LOAD_EXPR, &node->call.callee);
+    node->call.paren = need_token(l, in->field[1]);
+    node->call.args = load_nodes(l, in->list[0], index, LOAD_EXPR);
+    node->call.is_tail = in->flags & 1;
+    break;
+  case AST_GET:
+    need_node(l, in->field[0], index, LOAD_EXPR, &node->get.object);
+    node->get.name = need_token(l, in->field[1]);
+    break;
+  case AST_PRIMARY:
+    node->primary.value = need_token(l, in->field[0]);
+    node->primary.slot = -1;
+    break;
+  case AST_PROGRAM:
+  case AST_BLOCK:
+    break;
+  default:
+    l->ok = false; // Nothing the parser makes
+    break;
+  }
+
+  return node;
+}
+
+/* Loads the tree under root without recursing, so a deep tree can't run out
+   of stack. Every node is linked in as soon as it is made, so on failure the
+   partial tree can be freed from the root. */
+static AST_t *load_tree(CacheLoader *l, uint32_t root) {
+  AST_t *program = NULL;
+  need_node(l, root, CACHE_NONE, LOAD_PROGRAM, &program);
+
+  while (l->size > 0 && l->ok) {
+    LoadFrame frame = l->frames[--l->size];
+    *frame.slot = load_frame(l, frame);
+  }
+
+  mem_free(MEM_MISC, l->frames, l->capacity * sizeof(LoadFrame));
+  l->frames = NULL;
+  l->size = l->capacity = 0;
+  return program;
+}
+
+AST_t *cache_view_load(CacheView *view, Lexer *lexer) {
+  const CacheHeader *header = view->header;
+  array_T *list = lexer->token_list;
+  size_t first = list->size;
+  CacheLoader l = {.view = view, .ok = true};
+
+  for (uint32_t i = 0; i < header->token_count && l.ok; i++) {
+    const CacheToken *in = &view->tokens[i];
+    // The parser stops at the one TOKEN_EOF, which has to come last
+    bool last = i + 1 == header->token_count;
+    if (in->type > TOKEN_EOF || (in->type == TOKEN_EOF) != last ||
+        in->offset > header->source_len ||
+        (uint64_t)in->str + in->len >= header->string_size ||
+        view->strings[in->str + in->len] != '\0') {
+      l.ok = false;
+      break;
+    }
+
+    Token *token = mem_alloc(MEM_TOKEN, sizeof(Token));
+    char *str = mem_alloc(MEM_TOKEN_STRING, in->len + 1);
+    memcpy(str, view->strings + in->str, in->len);
+    token->type = in->type;
+    token->offset = in->offset;
+    token->pos.line = in->line;
+    token->pos.x = in->x;
+    token->str = str;
+    token->len = in->len;
+    array_push(list, token);
+  }
+
+  AST_t *program = NULL;
+  if (l.ok && header->token_count > 0) {
+    l.tokens = (Token **)list->items + first;
+    program = load_tree(&l, header->root);
+  }
+
+  if (!l.ok || program == NULL) {
+    PRINT_TRACE("%s", "Cache is corrupt, ignoring it");
+    ast_destroy(program);
+    while (list->size > first) {
+      token_destroy(list->items[--list->size]);
+    }
+    return NULL;
+  }
+
+  // Nothing left to lex
+  lexer->cursor = lexer->source_len + 1;
+  return program;
+}
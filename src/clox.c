@@ -0,0 +1,208 @@
+#include "include/clox.h"
+#include "include/ast.h"
+#include "include/diagnostic.h"
+#include "include/lexer.h"
+#include "include/list.h"
+#include "include/mem.h"
+#include "include/optimise.h"
+#include "include/parser.h"
+#include "include/resolver.h"
+#include "include/util.h"
+#include <string.h>
+
+typedef struct CloxNative {
+  char *name;
+  size_t name_len;
+  int arity;
+  CloxNativeFn fn;
+  void *userdata;
+} CloxNative;
+
+struct Clox {
+  CloxOptions options;
+  array_T *natives; // CloxNative*, kept across resets
+
+  // The compiled script, NULL until clox_compile succeeds
+  char *source;
+  size_t source_len;
+  Lexer *lexer;
+  Parser *parser;
+  AST_t *program;
+
+  // Errors from the last compile, kept until the next one or a reset
+  Diagnostics *diag;
+};
+
+Clox *clox_create(CloxOptions options) {
+  Clox *vm = mem_alloc(MEM_MISC, sizeof(Clox));
+  vm->options = options;
+  vm->natives = array_create(sizeof(CloxNative *));
+  return vm;
+}
+
+/* Frees the compiled script but not the errors from compiling it */
+static void drop_script(Clox *vm) {
+  // Reverse order since the AST points into the tokens
+  ast_destroy(vm->program);
+  if (vm->parser != NULL) {
+    parser_destroy(vm->parser);
+  }
+  if (vm->lexer != NULL) {
+    lexer_destroy(vm->lexer);
+  }
+  if (vm->source != NULL) {
+    mem_free(MEM_SOURCE, vm->source, vm->source_len + 1);
+  }
+
+  vm->source = NULL;
+  vm->source_len = 0;
+  vm->lexer = NULL;
+  vm->parser = NULL;
+  vm->program = NULL;
+}
+
+void clox_reset(Clox *vm) {
+  drop_script(vm);
+
+  if (vm->diag != NULL) {
+    diagnostics_destroy(vm->diag);
+  }
+  vm->diag = NULL;
+}
+
+void clox_destroy(Clox *vm) {
+  if (vm == NULL) {
+    return;
+  }
+
+  clox_reset(vm);
+
+  for (size_t i = 0; i < vm->natives->size; i++) {
+    CloxNative *native = vm->natives->items[i];
+    mem_free(MEM_MISC, native->name, native->name_len + 1);
+    mem_free(MEM_MISC, native, sizeof(CloxNative));
+  }
+  array_destroy(vm->natives);
+
+  mem_free(MEM_MISC, vm, sizeof(Clox));
+}
+
+CloxResult clox_compile(Clox *vm, const char *source, size_t len) {
+  clox_reset(vm);
+
+  vm->source = mem_alloc(MEM_SOURCE, len + 1);
+  memcpy(vm->source, source, len);
+  vm->source_len = len;
+
+  // Lazily parsed bodies report here too, so it lives as long as the lexer
+  vm->diag = diagnostics_create(vm->options.max_errors);
+
+  vm->lexer = lexer_init(vm->source, vm->source_len);
+  vm->lexer->diag = vm->diag;
+  vm->lexer->trace = vm->options.debug_trace; // The parser takes it from here
+  lexer_lex(vm->lexer);
+
+  vm->parser = init_parser(vm->lexer);
+  vm->parser->diag = vm->diag;
+  vm->parser->lazy = vm->options.lazy;
+  vm->program = parse_program(vm->parser);
+  if (vm->options.lazy) {
+    parse_used_bodies(vm->parser, vm->program);
+  }
+
+  if (diagnostics_count(vm->diag) > 0) {
+    drop_script(vm);
+    return CLOX_COMPILE_ERROR;
+  }
+
+  // Optimise first so nothing the resolver records is in a removed node
+  optimise_program(vm->program, vm->options.opt_level);
+  if (!resolve_program(vm->program, vm->diag)) {
+    drop_script(vm);
+    return CLOX_COMPILE_ERROR;
+  }
+
+  return CLOX_OK;
+}
+
+size_t clox_error_count(Clox *vm) {
+  return vm->diag != NULL ? vm->diag->items->size : 0;
+}
+
+size_t clox_error_total(Clox *vm) {
+  return vm->diag != NULL ? diagnostics_count(vm->diag) : 0;
+}
+
+bool clox_error_at(Clox *vm, size_t index, CloxError *error) {
+  if (index >= clox_error_count(vm)) {
+    return false;
+  }
+
+  Diagnostic *d = vm->diag->items->items[index];
+  error->line = d->pos.line + 1;
+  error->column = d->pos.x + 1;
+  error->start = d->start;
+  error->end = d->end;
+  error->message = d->msg;
+  return true;
+}
+
+CloxResult clox_run(Clox *vm) {
+  if (vm->program == NULL) {
+    PRINT_ERROR("%s", "Nothing has been compiled");
+    return CLOX_RUNTIME_ERROR;
+  }
+
+  PRINT_ERROR("%s", "There is no VM to run the script on yet");
+  return CLOX_RUNTIME_ERROR;
+}
+
+static CloxNative *find_native(Clox *vm, const char *name) {
+  size_t len = strlen(name);
+
+  for (size_t i = 0; i < vm->natives->size; i++) {
+    CloxNative *native = vm->natives->items[i];
+    if (native->name_len == len && memcmp(native->name, name, len) == 0) {
+      return native;
+    }
+  }
+
+  return NULL;
+}
+
+bool clox_define_native(Clox *vm, const char *name, int arity,
+                        CloxNativeFn fn, void *userdata) {
+  if (find_native(vm, name) != NULL) {
+    PRINT_ERROR("Native `%s` is already defined", name);
+    return false;
+  }
+
+  CloxNative *native = mem_alloc(MEM_MISC, sizeof(CloxNative));
+  native->name_len = strlen(name);
+  native->name = mem_alloc(MEM_MISC, native->name_len + 1);
+  memcpy(native->name, name, native->name_len);
+  native->arity = arity;
+  native->fn = fn;
+  native->userdata = userdata;
+
+  array_push(vm->natives, native);
+  return true;
+}
+
+bool clox_call_native(Clox *vm, const char *name, int argc,
+                      const CloxValue *args, CloxValue *result) {
+  CloxNative *native = find_native(vm, name);
+  if (native == NULL) {
+    PRINT_ERROR("No native named `%s`", name);
+    return false;
+  }
+
+  if (native->arity != -1 && native->arity != argc) {
+    PRINT_ERROR("Native `%s` takes %d argument(s) but got %d", name,
+                native->arity, argc);
+    return false;
+  }
+
+  *result = native->fn(vm, argc, args, native->userdata);
+  return true;
+}
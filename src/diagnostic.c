@@ -0,0 +1,154 @@
+#include "include/diagnostic.h"
+#include "include/mem.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+Diagnostics *diagnostics_create(size_t max) {
+  Diagnostics *diag = mem_alloc(MEM_MISC, sizeof(Diagnostics));
+  diag->items = array_create(sizeof(Diagnostic *));
+  diag->max = max;
+  return diag;
+}
+
+static void diagnostic_free(Diagnostic *d) {
+  mem_free(MEM_MISC, d->msg, strlen(d->msg) + 1);
+  mem_free(MEM_MISC, d, sizeof(Diagnostic));
+}
+
+void diagnostics_destroy(Diagnostics *diag) {
+  if (diag == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < diag->items->size; i++) {
+    diagnostic_free(diag->items->items[i]);
+  }
+  array_destroy(diag->items);
+  mem_free(MEM_MISC, diag, sizeof(Diagnostics));
+}
+
+/* Adds d in source order, after any kept error at the same offset. Once the
+   cap is reached the error furthest into the source is the one dropped, so
+   the earliest ones are shown whatever order they were reported in. */
+static void diagnostics_add(Diagnostics *diag, Diagnostic *d) {
+  array_T *items = diag->items;
+
+  if (diag->max != 0 && items->size >= diag->max) {
+    diag->dropped++;
+    Diagnostic *last = items->items[items->size - 1];
+    if (d->start >= last->start) {
+      diagnostic_free(d);
+      return;
+    }
+    diagnostic_free(last);
+    items->size--;
+  }
+
+  // Errors mostly come in source order, so this rarely moves anything
+  array_push(items, d);
+  size_t i = items->size - 1;
+  while (i > 0 && ((Diagnostic *)items->items[i - 1])->start > d->start) {
+    items->items[i] = items->items[i - 1];
+    i--;
+  }
+  items->items[i] = d;
+}
+
+void diagnostics_vreport(Diagnostics *diag, enum error_type type, size_t start,
+                         size_t end, LinePosition pos, const char *format,
+                         va_list args) {
+  if (diag == NULL) {
+    fprintf(stderr, "ERROR-> line %zu: ", pos.line + 1);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    exit(1);
+  }
+
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(NULL, 0, format, copy);
+  va_end(copy);
+  assert(len >= 0 && "Bad diagnostic format");
+
+  Diagnostic *d = mem_alloc(MEM_MISC, sizeof(Diagnostic));
+  d->type = type;
+  d->start = start;
+  d->end = end;
+  d->pos = pos;
+  d->msg = mem_alloc(MEM_MISC, (size_t)len + 1);
+  vsnprintf(d->msg, (size_t)len + 1, format, args);
+
+  diagnostics_add(diag, d);
+}
+
+void diagnostics_report(Diagnostics *diag, enum error_type type, size_t start,
+                        size_t end, LinePosition pos, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  diagnostics_vreport(diag, type, start, end, pos, format, args);
+  va_end(args);
+}
+
+size_t diagnostics_count(Diagnostics *diag) {
+  return diag->items->size + diag->dropped;
+}
+
+void diagnostics_merge(Diagnostics *diag, Diagnostics *from) {
+  for (size_t i = 0; i < from->items->size; i++) {
+    diagnostics_add(diag, from->items->items[i]);
+  }
+
+  diag->dropped += from->dropped;
+  from->items->size = 0;
+  from->dropped = 0;
+}
+
+static const char *error_type_to_str(enum error_type type) {
+  switch (type) {
+  case SYNTAX:
+    return "syntax error";
+  case TYPE_ERR:
+    return "type error";
+  case NONE:
+  case MISC:
+    break;
+  }
+
+  return "error";
+}
+
+void diagnostics_print(Diagnostics *diag, const char *filename,
+                       const char *source, size_t source_len, FILE *out) {
+  for (size_t i = 0; i < diag->items->size; i++) {
+    Diagnostic *d = diag->items->items[i];
+
+    // Lines and columns are printed from 1, as editors count them
+    fprintf(out, "%s:%zu:%zu: %s: %s\n", filename, d->pos.line + 1,
+            d->pos.x + 1, error_type_to_str(d->type), d->msg);
+
+    size_t line_start = d->start - d->pos.x;
+    size_t line_end = d->start;
+    while (line_end < source_len && source[line_end] != '\n' &&
+           source[line_end] != '\r') {
+      line_end++;
+    }
+
+    fprintf(out, "  %.*s\n  ", (int)(line_end - line_start),
+            source + line_start);
+    // Keep tabs so the caret lines up with the source above it
+    for (size_t j = line_start; j < d->start; j++) {
+      fputc(source[j] == '\t' ? '\t' : ' ', out);
+    }
+    fputc('^', out);
+    // Underline the rest of the span, up to the end of the line
+    for (size_t j = d->start + 1; j < d->end && j < line_end; j++) {
+      fputc('~', out);
+    }
+    fputc('\n', out);
+  }
+
+  if (diag->dropped > 0) {
+    fprintf(out, "%s: %zu more error(s) not shown\n", filename, diag->dropped);
+  }
+}
@@ -16,6 +16,8 @@ typedef enum {
   AST_STATEMENT,
   AST_DECLARATION,
   AST_BLOCK,
+  AST_IF_STMT,
+  AST_RETURN_STMT,
   AST_VAR,
   // Expressions (produces values)
   AST_EXPR,
@@ -23,6 +25,7 @@ typedef enum {
   AST_BINARY,
   AST_UNARY,
   AST_CALL,
+  AST_GET,
   AST_PRIMARY,
   AST_NOTHING,
 } AST_Type;
@@ -30,6 +33,9 @@ typedef enum {
 typedef struct AST_STRUCT {
   AST_Type type;
   array_T *children;
+  Token *owned_token; // Token made by a pass rather than the lexer, if any
+  size_t token_start; // Top-level declarations: first token parsed
+  size_t token_end;   // Top-level declarations: one past the last token
 
   union {
 
@@ -37,6 +43,8 @@ typedef struct AST_STRUCT {
       Token *name;
       bool has_body;
       array_T *children;
+      int slot;      // Stack slot of the class variable (-1 if global)
+      bool captured; // Set by the resolver if a closure captures it
 
     } class_decl;
 
@@ -45,6 +53,13 @@ typedef struct AST_STRUCT {
       bool has_body;
       array_T *args;
       array_T *children;
+      int slot;           // Stack slot of the function variable (-1 if global)
+      bool captured;      // Set by the resolver if a closure captures it
+      size_t local_count; // Highest number of slots live at once
+      array_T *locals;    // Every Local declared in this function
+      array_T *upvalues;  // Upvalues captured by this function, in order
+      bool is_lazy;       // Body skipped by the parser, not parsed yet
+      size_t body_start;  // Token index of the body's `{` (lazy bodies)
 
     } func_decl;
 
@@ -52,6 +67,8 @@ typedef struct AST_STRUCT {
       Token *name;
       bool has_val;
       struct AST_STRUCT *value;
+      int slot;      // Stack slot of the variable (-1 if global)
+      bool captured; // Set by the resolver if a closure captures it
     } var_decl;
 
     struct {
@@ -65,6 +82,51 @@ typedef struct AST_STRUCT {
     struct {
       Token *num;
     } int_literal;
+
+    struct {
+      struct AST_STRUCT *expr; // NULL for an empty statement (`;`)
+    } expr_stmt;
+
+    struct {
+      struct AST_STRUCT *condition;
+      struct AST_STRUCT *then_branch;
+      struct AST_STRUCT *else_branch; // NULL if there is no `else`
+    } if_stmt;
+
+    struct {
+      Token *keyword;
+      struct AST_STRUCT *value; // NULL for a bare `return;`
+    } return_stmt;
+
+    struct {
+      struct AST_STRUCT *left;
+      Token *op;
+      struct AST_STRUCT *right;
+    } binary;
+
+    struct {
+      Token *op;
+      struct AST_STRUCT *right;
+    } unary;
+
+    struct {
+      struct AST_STRUCT *callee;
+      Token *paren;   // Closing parenthesis, for error reporting
+      array_T *args;  // NULL if called with no arguments
+      bool is_tail;   // Set by the resolver for `return f(...)`
+    } call;
+
+    struct {
+      struct AST_STRUCT *object;
+      Token *name;
+    } get;
+
+    // `true`, `false`, `nil`, `this` and variable references
+    struct {
+      Token *value;
+      int slot;        // Set by the resolver (-1 if global)
+      bool is_upvalue; // Set by the resolver if slot is an upvalue index
+    } primary;
   };
 
 } AST_t;
@@ -147,7 +209,27 @@ typedef struct AST_STRUCT {
 AST_t *ast_create(AST_Type type);
 char *ast_type_to_str(AST_Type type); // TODO
 
+/* What a visitor wants to happen after seeing a node */
+typedef enum AST_VisitResult {
+  AST_VISIT_CONTINUE, // Carry on into the node's children
+  AST_VISIT_SKIP,     // Leave out the node's children (pre only)
+  AST_VISIT_STOP,     // End the traversal
+} AST_VisitResult;
+
+/* depth is 0 for the node the traversal started at */
+typedef AST_VisitResult (*AST_VisitFn)(AST_t *node, size_t depth, void *ctx);
+
+/* Walks the tree rooted at root with a heap allocated stack, so the depth of
+   the tree is not limited by the C stack. pre is called on a node before its
+   children and post after them, children being visited in source order.
+   Either may be NULL, and post may free the node it is given. */
+void ast_visit(AST_t *root, AST_VisitFn pre, AST_VisitFn post, void *ctx);
+
 void pretty_print_ast(AST_t *node, int depth);
+size_t ast_count_nodes(AST_t *node);
+bool ast_equal(AST_t *a, AST_t *b);
+void ast_destroy(AST_t *node);
+void ast_destroy_except(AST_t *node, AST_t *keep);
 
 /* AST_t *ast_assign(Token *name, AST_t *value); */
 /* AST_t *ast_binary(AST_t *left, Token *operator, AST_t * right); */
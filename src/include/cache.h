@@ -0,0 +1,99 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include "ast.h"
+#include "lexer.h"
+#include "util.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************/
+/*                            Front-end cache files                          */
+/*****************************************************************************/
+
+/* A cache file holds the tokens and parse tree of one source file. Every
+   reference in it is an index into one of its tables, so a mapped file can
+   be read in place without fixing up pointers. Integers are in host byte
+   order; CACHE_VERSION changes whenever the layout does. */
+
+#define CACHE_MAGIC 0x584f4c43u // "CLOX" when stored little endian
+#define CACHE_VERSION 2
+#define CACHE_NONE UINT32_MAX // Missing token, node or array
+
+#define CACHE_FLAG_LAZY 1u // Parsed with lazy function bodies
+
+typedef struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash; // hash_fnv1a of the source
+  uint64_t source_len;
+  uint64_t checksum;    // FNV-1a of the header (this as 0) and tables
+  uint32_t flags;       // CACHE_FLAG_*
+  uint32_t lazy_bodies; // Function bodies skipped by a lazy parse
+  uint32_t token_count;
+  uint32_t node_count;
+  uint32_t ref_count;
+  uint32_t string_size;
+  uint32_t root;          // Node index of the program
+  uint32_t tokens_offset; // Byte offsets of each table from the file start
+  uint32_t nodes_offset;
+  uint32_t refs_offset;
+  uint32_t strings_offset;
+  uint32_t reserved;
+} CacheHeader;
+
+typedef struct CacheToken {
+  uint32_t type;
+  uint32_t offset;
+  uint32_t line;
+  uint32_t x;
+  uint32_t len;
+  uint32_t str; // Offset into the string table ('\0' terminated)
+} CacheToken;
+
+/* A run of entries in the reference table (count is CACHE_NONE for NULL) */
+typedef struct CacheArray {
+  uint32_t first;
+  uint32_t count;
+} CacheArray;
+
+/* One AST node. What the fields and lists hold depends on the type, see
+   node_fields in cache.c. */
+typedef struct CacheNode {
+  uint32_t type;
+  uint32_t flags; // has_body, has_val, is_tail or is_lazy
+  uint32_t token_start;
+  uint32_t token_end;
+  uint32_t field[4]; // Token or node indices
+  CacheArray children;
+  CacheArray list[2];
+} CacheNode;
+
+/* A cache file mapped for reading */
+typedef struct CacheView {
+  File_t *file;
+  const CacheHeader *header;
+  const CacheToken *tokens;
+  const CacheNode *nodes;
+  const uint32_t *refs;
+  const char *strings;
+} CacheView;
+
+/* Writes the tokens and (unresolved) tree of a source file to path */
+bool cache_write(const char *path, uint64_t source_hash, size_t source_len,
+                 uint32_t flags, uint32_t lazy_bodies, array_T *tokens,
+                 AST_t *program);
+
+/* Maps a cache file. Returns false if it is missing, malformed, corrupted or
+   was made from a different source or with different flags. */
+bool cache_view_open(CacheView *view, char *path, uint64_t source_hash,
+                     size_t source_len, uint32_t flags);
+void cache_view_close(CacheView *view);
+
+/* Builds the tokens of a view into lexer's token list, and returns the tree.
+   Returns NULL, adding no tokens, if the tables don't describe a tree the
+   parser could have made. */
+AST_t *cache_view_load(CacheView *view, Lexer *lexer);
+
+#endif // CACHE_H_
@@ -0,0 +1,88 @@
+#ifndef CLOX_H_
+#define CLOX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+/*                               Embedding API                               */
+/*****************************************************************************/
+
+/* An interpreter instance. Instances share nothing but the process-wide
+   memory accounting in mem.h, so any number can be alive at once (one thread
+   per instance). */
+typedef struct Clox Clox;
+
+typedef enum CloxResult {
+  CLOX_OK,
+  CLOX_COMPILE_ERROR,
+  CLOX_RUNTIME_ERROR,
+} CloxResult;
+
+typedef enum CloxValueType {
+  CLOX_NIL,
+  CLOX_BOOL,
+  CLOX_NUMBER,
+  CLOX_STRING,
+} CloxValueType;
+
+/* A value passed across the API. Strings are borrowed, not copied. */
+typedef struct CloxValue {
+  CloxValueType type;
+  union {
+    bool boolean;
+    double number;
+    const char *string;
+  } as;
+} CloxValue;
+
+/* A host function callable from scripts */
+typedef CloxValue (*CloxNativeFn)(Clox *vm, int argc, const CloxValue *args,
+                                  void *userdata);
+
+typedef struct CloxOptions {
+  int opt_level;     // Optimiser level, see optimise.h
+  bool lazy;         // Skip function bodies the script cannot reach
+  size_t max_errors; // Most errors kept per compile, all are counted (0: all)
+  bool debug_trace;  // Print this instance's lexer and parser traces and dumps
+} CloxOptions;
+
+Clox *clox_create(CloxOptions options);
+void clox_destroy(Clox *vm);
+
+/* Compiles a script, replacing any compiled before. The source is copied.
+   Errors give CLOX_COMPILE_ERROR and are read with clox_error_at. */
+CloxResult clox_compile(Clox *vm, const char *source, size_t len);
+/* Runs the compiled script.
+   NOTE: There is no VM yet, so this fails with CLOX_RUNTIME_ERROR */
+CloxResult clox_run(Clox *vm);
+/* Drops the compiled script and its errors but keeps the natives and options,
+   so the instance can compile the next script without being created again */
+void clox_reset(Clox *vm);
+
+/* A compile error, spanning the bytes [start, end) of the source */
+typedef struct CloxError {
+  size_t line;         // From 1
+  size_t column;       // Byte in the line, from 1
+  size_t start;
+  size_t end;
+  const char *message; // Owned by the instance until the next compile
+} CloxError;
+
+/* Errors kept from the last compile, earliest in the source first. Past
+   CloxOptions.max_errors the rest are only counted in clox_error_total. */
+size_t clox_error_count(Clox *vm);
+size_t clox_error_total(Clox *vm);
+/* Fills in the index-th kept error, returns false if there is none */
+bool clox_error_at(Clox *vm, size_t index, CloxError *error);
+
+/* Makes fn callable as the global `name`. arity is -1 for any number of
+   arguments. Returns false if a native of that name already exists. */
+bool clox_define_native(Clox *vm, const char *name, int arity,
+                        CloxNativeFn fn, void *userdata);
+/* Calls the native `name`, returns false if there is none or the arity is
+   wrong */
+bool clox_call_native(Clox *vm, const char *name, int argc,
+                      const CloxValue *args, CloxValue *result);
+
+#endif // CLOX_H_
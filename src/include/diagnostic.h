@@ -0,0 +1,56 @@
+#ifndef DIAGNOSTIC_H_
+#define DIAGNOSTIC_H_
+
+#include "list.h"
+#include "token.h"
+#include "util.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*****************************************************************************/
+/*                                Diagnostics                                */
+/*****************************************************************************/
+
+/* Errors before anything is cut off, unless the caller picks a cap */
+#define DIAGNOSTICS_DEFAULT_MAX 20
+
+/* One error, spanning the bytes [start, end) of the source */
+typedef struct Diagnostic {
+  enum error_type type;
+  size_t start;
+  size_t end;
+  LinePosition pos; // Position of start
+  char *msg;
+} Diagnostic;
+
+/* Collects errors so a whole file is checked in one run. Past the cap errors
+   are still counted, but only the ones earliest in the source are kept. */
+typedef struct Diagnostics {
+  array_T *items; // Diagnostic*, by start (ties in the order reported)
+  size_t max;     // Most errors kept (0 for no cap)
+  size_t dropped; // Errors counted but not kept
+} Diagnostics;
+
+Diagnostics *diagnostics_create(size_t max);
+void diagnostics_destroy(Diagnostics *diag);
+
+/* Records an error. With no Diagnostics to collect it in (diag is NULL) the
+   error is printed and the process exits, as it did before. */
+void diagnostics_report(Diagnostics *diag, enum error_type type, size_t start,
+                        size_t end, LinePosition pos, const char *format, ...);
+void diagnostics_vreport(Diagnostics *diag, enum error_type type, size_t start,
+                         size_t end, LinePosition pos, const char *format,
+                         va_list args);
+/* Every error reported, kept or not */
+size_t diagnostics_count(Diagnostics *diag);
+/* Moves every diagnostic in from into diag, as if it had been reported there,
+   leaving from empty */
+void diagnostics_merge(Diagnostics *diag, Diagnostics *from);
+
+/* Prints every diagnostic with its line of source underlined */
+void diagnostics_print(Diagnostics *diag, const char *filename,
+                       const char *source, size_t source_len, FILE *out);
+
+#endif // DIAGNOSTIC_H_
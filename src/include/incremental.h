@@ -0,0 +1,63 @@
+#ifndef INCREMENTAL_H_
+#define INCREMENTAL_H_
+
+#include "ast.h"
+#include "diagnostic.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+/*                         Incremental lexing/parsing                        */
+/*****************************************************************************/
+
+/* A source buffer kept lexed and parsed across edits. While the source has
+   errors every edit lexes and parses it from scratch, so the errors are the
+   ones a full parse would find; edits to a clean source stay incremental. */
+typedef struct Document {
+  char *source; // Current source text, '\0' terminated
+  size_t source_len;
+  Lexer *lexer;      // Tokens for source
+  Parser *parser;    // Reused to re-parse declarations
+  AST_t *program;    // Parse tree for source (not resolved or optimised)
+  Diagnostics *diag; // Errors in source, empty if it parsed cleanly
+
+  // The last version of the source without errors, kept while the current
+  // one has some (all NULL otherwise)
+  char *good_source;
+  size_t good_len;
+  Lexer *good_lexer;
+  AST_t *good_program;
+} Document;
+
+/* Replaces old_len bytes at start with new_len bytes of text */
+typedef struct Edit {
+  size_t start;
+  size_t old_len;
+  const char *text;
+  size_t new_len;
+} Edit;
+
+typedef struct EditStats {
+  size_t tokens_relexed; // Tokens produced by lexing the edited region
+  size_t tokens_reused;  // Old tokens kept (positions shifted)
+  size_t decls_reparsed; // Top-level declarations parsed again
+  size_t decls_reused;   // Top-level declarations kept as they were
+} EditStats;
+
+Document *document_create(const char *source, size_t len);
+/* Applies an edit, re-lexing and re-parsing only what it touches */
+EditStats document_edit(Document *doc, Edit edit);
+/* Number of errors in the current source, see doc->diag for them */
+size_t document_error_count(Document *doc);
+/* The tree of the current source if it has no errors, otherwise of the last
+   version that had none (NULL if there never was one) */
+AST_t *document_last_good(Document *doc);
+void document_destroy(Document *doc);
+
+/* Applies random edits to a file, some of which break it, and checks every
+   result against a full parse. Returns false on the first mismatch. */
+bool test_incremental(char *filename, size_t iterations, unsigned seed);
+
+#endif // INCREMENTAL_H_
@@ -1,6 +1,7 @@
 #ifndef LEXER_H_
 #define LEXER_H_
 
+#include "diagnostic.h"
 #include "list.h"
 #include "token.h"
 #include <stdbool.h>
@@ -13,11 +14,16 @@ typedef struct Lexer {
   size_t source_len;  // Length of the source file
   array_T *token_list;
   size_t cursor;              // Tracks the position of where we have scanned
-  LinePosition line_position; // FIXME Which line we are in and where
+  LinePosition line_position; // Which line we are in and where
+  size_t line_start;          // Offset of the first byte of the current line
+  Diagnostics *diag;          // Where errors go (NULL makes them fatal)
+  bool trace; // Print traces and the token list (debug_trace by default)
 } Lexer;
 
 void test_lexer(void);
 Lexer *lexer_init(char *source, size_t filesize);
 void lexer_lex(Lexer *lexer);
+Token *lexer_next_token(Lexer *lexer);
+void lexer_destroy(Lexer *lex);
 
 #endif // LEXER_H_
@@ -11,6 +11,7 @@ typedef struct ARRAY_STRUCT {
 
   void **items;
   size_t size;
+  size_t capacity; // Number of items there is room for
   size_t item_size;
 
 } array_T;
@@ -0,0 +1,46 @@
+#ifndef MEM_H_
+#define MEM_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*****************************************************************************/
+/*                             Memory accounting                             */
+/*****************************************************************************/
+
+/* Which subsystem an allocation belongs to */
+typedef enum MemTag {
+  MEM_SOURCE,       // Source text read into memory
+  MEM_LEXER,        // Lexer struct
+  MEM_TOKEN,        // Token structs
+  MEM_TOKEN_STRING, // Token strings
+  MEM_PARSER,       // Parser struct
+  MEM_AST,          // AST nodes
+  MEM_ARRAY,        // Dynamic arrays (token lists, child arrays, ...)
+  MEM_LIST,         // Linked list nodes
+  MEM_RESOLVER,     // Locals and upvalues recorded by the resolver
+  MEM_MISC,         // Everything else
+  MEM_TAG_COUNT
+} MemTag;
+
+typedef struct MemStats {
+  size_t live;   // Bytes currently allocated
+  size_t peak;   // Highest value live has reached
+  size_t allocs; // Number of allocations
+  size_t frees;  // Number of frees
+} MemStats;
+
+/* Allocates size zeroed bytes */
+void *mem_alloc(MemTag tag, size_t size);
+/* Resizes an allocation of old_size bytes (ptr may be NULL) */
+void *mem_realloc(MemTag tag, void *ptr, size_t old_size, size_t new_size);
+/* Frees an allocation of size bytes */
+void mem_free(MemTag tag, void *ptr, size_t size);
+
+MemStats mem_stats(MemTag tag);
+MemStats mem_stats_total(void);
+const char *mem_tag_to_str(MemTag tag);
+/* Prints a table of every subsystem plus the process' peak RSS */
+void mem_report(FILE *out);
+
+#endif // MEM_H_
@@ -0,0 +1,24 @@
+#ifndef OPTIMISE_H_
+#define OPTIMISE_H_
+
+#include "ast.h"
+#include <stddef.h>
+
+/*****************************************************************************/
+/*                                Optimisation                               */
+/*****************************************************************************/
+
+/* Optimisation levels */
+#define OPT_LEVEL_NONE 0 // Leave the tree as it was parsed
+#define OPT_LEVEL_FOLD 1 // Fold constants and simplify `!` chains
+#define OPT_LEVEL_DEAD 2 // Also remove dead branches and statements
+
+typedef struct OptStats {
+  size_t folded;  // Number of expressions replaced by a constant
+  size_t removed; // Number of nodes removed from the tree
+} OptStats;
+
+/* Optimises the tree in place between parsing and code generation */
+OptStats optimise_program(AST_t *program, int level);
+
+#endif // OPTIMISE_H_
@@ -0,0 +1,24 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "ast.h"
+#include "parser.h"
+#include <stddef.h>
+
+/*****************************************************************************/
+/*                          Parallel top-level parsing                       */
+/*****************************************************************************/
+
+/* Slices smaller than this many tokens are merged with the next one, so
+   workers are not handed single tiny declarations */
+#define PARALLEL_MIN_SLICE 256
+
+/* Parses the program with up to jobs threads. The tokens are cut into slices
+   in front of every top-level `class` and `fun`, found by counting brackets,
+   and the slices are parsed by whichever thread is free. The tree is the one
+   parse_program would make: if any slice has an error, or a declaration does
+   not end where its slice does, the whole program is parsed again with
+   parse_program so the errors come out as usual. */
+AST_t *parse_program_parallel(Parser *parser, size_t jobs);
+
+#endif // PARALLEL_H_
@@ -2,8 +2,10 @@
 #define PARSER_H_
 
 #include "ast.h"
+#include "diagnostic.h"
 #include "lexer.h"
 #include "list.h"
+#include "pipeline.h"
 #include "token.h"
 #include "util.h"
 
@@ -15,10 +17,27 @@
 typedef struct PARSER_STRUCT {
   Lexer *lexer;
   Token *token;
+  size_t index; // Index of token in the lexer's token list
+  bool lazy;    // Skip top-level function bodies until they are used
+  int depth;    // How many blocks deep we are
+  size_t lazy_bodies; // Bodies skipped so far
+  Diagnostics *diag;  // Where errors go (NULL makes them fatal)
+  bool panic;         // Set after an error until the next declaration
+  LexPipeline *pipeline; // Source still being lexed (NULL once it all is)
+  bool trace;            // Print traces and the tree (the lexer's by default)
 } Parser;
 
 Parser *init_parser(Lexer *lex);
+void parser_seek(Parser *parser, size_t index);
+AST_t *parse_declaration(Parser *parser);
 AST_t *parse_program(Parser *parser);
+/* Parses a function body skipped by a lazy parse, returns false if the body
+   had already been parsed */
+bool parse_lazy_body(Parser *parser, AST_t *function);
+/* Parses the skipped bodies of every function the script can reach, returns
+   how many it parsed */
+size_t parse_used_bodies(Parser *parser, AST_t *program);
+void parser_destroy(Parser *parser);
 void pretty_print_ast(AST_t *ast, int depth);
 
 #endif // PARSER_H_
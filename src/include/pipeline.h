@@ -0,0 +1,70 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "diagnostic.h"
+#include "lexer.h"
+#include "token.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+/*                              Pipelined lexing                             */
+/*****************************************************************************/
+
+/* With a pipeline the source is lexed on a second thread while the parser
+   works through the tokens made so far. Tokens are handed over in batches
+   through a single producer, single consumer ring, so the two threads only
+   touch shared state once per batch. */
+
+#define TOKEN_BATCH_SIZE 512 // Tokens handed over at once
+#define TOKEN_RING_SIZE 64   // Batches in flight
+#define CACHE_LINE_SIZE 64
+
+typedef struct TokenBatch {
+  size_t count;
+  Token *tokens[TOKEN_BATCH_SIZE];
+} TokenBatch;
+
+/* Each side's fields are kept a cache line apart from the other's, so the
+   threads do not keep taking the line from each other. Each side also keeps
+   the last index it saw of the other, and only loads it again when the ring
+   looks full or empty. */
+typedef struct TokenRing {
+  // Lexer thread
+  _Atomic size_t head; // Batches published
+  _Atomic bool closed; // Set once the last batch has been published
+  size_t tail_seen;
+  char pad_producer[CACHE_LINE_SIZE];
+
+  // Parser thread
+  _Atomic size_t tail; // Batches taken
+  size_t head_seen;
+  char pad_consumer[CACHE_LINE_SIZE];
+
+  TokenBatch batches[TOKEN_RING_SIZE];
+} TokenRing;
+
+typedef struct LexPipeline {
+  Lexer *lexer;      // Collects the tokens, in token_list, for the parser
+  Lexer *producer;   // Lexes the source on the second thread
+  Diagnostics *diag; // The producer's errors, until they are merged
+  TokenRing *ring;
+  pthread_t thread;
+} LexPipeline;
+
+/* Starts lexing the source of lexer on a second thread, and returns once the
+   first batch is in lexer->token_list. Returns NULL if no thread could be
+   started, in which case the caller should lex as usual. */
+LexPipeline *lex_pipeline_start(Lexer *lexer);
+
+/* Makes sure lexer->token_list holds the token at index, waiting for the
+   lexer thread if needed. Returns false if the source ends before it. */
+bool lex_pipeline_fill(LexPipeline *pipeline, size_t index);
+
+/* Takes the rest of the tokens, merges the lexer thread's errors into the
+   lexer's and frees the pipeline. The lexer is left as lexer_lex leaves it. */
+void lex_pipeline_finish(LexPipeline *pipeline);
+
+#endif // PIPELINE_H_
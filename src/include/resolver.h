@@ -0,0 +1,60 @@
+#ifndef RESOLVER_H_
+#define RESOLVER_H_
+
+#include "ast.h"
+#include "diagnostic.h"
+#include "list.h"
+#include "token.h"
+#include <stdbool.h>
+
+/*****************************************************************************/
+/*                                 Resolving                                 */
+/*****************************************************************************/
+
+/* Most locals one function can have live at once (slots are a single byte) */
+#define RESOLVER_MAX_LOCALS 256
+/* Most upvalues a single closure can capture */
+#define RESOLVER_MAX_UPVALUES 256
+
+/* A local variable as the resolver sees it */
+typedef struct Local {
+  Token *name;   // Name of the variable
+  int depth;     // Scope depth it was declared in (-1 while uninitialised)
+  int slot;      // Index into the function's stack window
+  bool captured; // True if a closure captures it (must be boxed)
+  AST_t *decl;   // Node that declared it (NULL for parameters)
+} Local;
+
+/* An upvalue captured by a closure */
+typedef struct Upvalue {
+  int index;     // Slot (if local) or upvalue index in the enclosing function
+  bool is_local; // True if it captures a local of the enclosing function
+} Upvalue;
+
+/* Per-function resolver state, chained to the enclosing function */
+typedef struct FunctionScope {
+  struct FunctionScope *enclosing;
+  AST_t *function; // AST_FUNC_DECL being resolved (NULL for the script)
+  Local *locals[RESOLVER_MAX_LOCALS]; // Locals currently in scope
+  size_t local_count;
+  Upvalue *upvalues[RESOLVER_MAX_UPVALUES];
+  size_t upvalue_count;
+  int scope_depth;
+  bool is_initializer; // `init` methods always return `this`
+} FunctionScope;
+
+typedef struct Resolver {
+  FunctionScope *current; // Innermost function being resolved
+  Diagnostics *diag;      // Where errors go
+  size_t error_count;
+} Resolver;
+
+/* Resolves every name in the program, reporting errors to diag. Returns false
+   if there were any. */
+bool resolve_program(AST_t *program, Diagnostics *diag);
+
+/* Resolves a name used inside the current function. Returns the local slot,
+   or the upvalue index if is_upvalue is set, or -1 if the name is global. */
+int resolve_name(Resolver *resolver, Token *name, bool *is_upvalue);
+
+#endif // RESOLVER_H_
@@ -0,0 +1,53 @@
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*****************************************************************************/
+/*                                Pass timing                                */
+/*****************************************************************************/
+
+/* The stages a source file goes through */
+typedef enum Phase {
+  PHASE_READ,     // Mapping or reading the source
+  PHASE_CACHE,    // Loading or writing a cache file
+  PHASE_LEX,      // lexer_lex
+  PHASE_PARSE,    // parse_program, plus lazily parsed bodies
+  PHASE_RESOLVE,  // resolve_program
+  PHASE_OPTIMISE, // optimise_program
+  PHASE_COUNT
+} Phase;
+
+typedef struct PhaseStats {
+  uint64_t wall_ns; // Monotonic clock
+  uint64_t cpu_ns;  // Process CPU time
+  size_t runs;
+  size_t bytes; // Source bytes the phase went through
+  size_t items; // Tokens or nodes it made or visited
+} PhaseStats;
+
+/* Totals per phase, summed over every file timed */
+typedef struct PassTimes {
+  PhaseStats phases[PHASE_COUNT];
+  size_t files;
+} PassTimes;
+
+/* Start of one timed run, from timer_start */
+typedef struct PhaseTimer {
+  uint64_t wall;
+  uint64_t cpu;
+} PhaseTimer;
+
+PhaseTimer timer_start(void);
+/* Adds the time since start to phase */
+void timer_stop(PassTimes *times, Phase phase, PhaseTimer start, size_t bytes,
+                size_t items);
+
+const char *phase_to_str(Phase phase);
+/* Prints a table of every phase that ran, or a JSON object if json is set */
+void pass_times_report(PassTimes *times, FILE *out, bool json);
+
+#endif // TIMING_H_
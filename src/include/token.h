@@ -1,6 +1,7 @@
 #ifndef TOKEN_H_
 #define TOKEN_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* A list of token types */
@@ -54,14 +55,15 @@ typedef enum TokenType {
 } TokenType;
 
 typedef struct LinePosition {
-  size_t line; // Line number
-  size_t x;    // Where in the line
+  size_t line; // Line number (from 0)
+  size_t x;    // Byte offset into the line (from 0)
 } LinePosition;
 
 /* Token structure. */
 typedef struct Token {
   TokenType type;   // Token type
-  LinePosition pos; // FIXME Its position in source
+  LinePosition pos; // Its position in source
+  size_t offset;    // Byte offset of the lexeme (a string's opening quote)
   const char *str;  // String literal
   size_t len;       // Length of the token
 } Token;
@@ -73,5 +75,8 @@ typedef struct KeyWord {
 } KeyWord;
 
 char *tokentype_to_string(TokenType type);
+void token_destroy(void *tkn);
+size_t token_lexeme_end(Token *token);
+bool token_equal(Token *a, Token *b);
 
 #endif // TOKEN_H_
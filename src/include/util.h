@@ -1,6 +1,8 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -10,6 +12,12 @@
 #define DEBUG 1
 #define TRACING 1
 
+/* Default for the front end's debug output (traces, token and tree dumps).
+   Only the nicer executable sets it, once before any work starts; library
+   code never writes it. Lexers and parsers take a copy (their trace field)
+   that each Clox instance sets from its own options. */
+extern bool debug_trace;
+
 // Macro to print an error to stderr
 #define PRINT_ERROR(format, ...)                                               \
   do {                                                                         \
@@ -23,14 +31,17 @@
 /*     ISSUE_ERROR("%s", __VA_ARGS__); \ */
 /*   } while (0) */
 
-// For tracing
-#define PRINT_TRACE(format, ...)                                               \
+// For tracing, when on is true
+#define PRINT_TRACE_IF(on, format, ...)                                        \
   do {                                                                         \
-    if (TRACING)                                                               \
+    if (TRACING && (on))                                                       \
       fprintf(stderr, "TRACE-> %s:%d: %s(): " format "\n", __FILE__, __LINE__, \
               __func__, __VA_ARGS__);                                          \
   } while (0)
 
+#define PRINT_TRACE(format, ...)                                               \
+  PRINT_TRACE_IF(debug_trace, format, __VA_ARGS__)
+
 /* #define PRINT_TRACE(...) \ */
 /*   do { \ */
 /*     ISSUE_TRACE("%s", __VA_ARGS__); \ */
@@ -39,11 +50,20 @@
 // Debugging message one liner
 #define PUT_TRACE(msg)                                                         \
   do {                                                                         \
-    if (TRACING)                                                               \
+    if (TRACING && debug_trace)                                                \
       fprintf(stderr, "TRACE->%s:%d: %s(): " msg "\n", __FILE__, __LINE__,     \
               __func__);                                                       \
   } while (0)
 
+// Debug output to stdout, when on is true
+#define PRINT_DEBUG_IF(on, ...)                                                \
+  do {                                                                         \
+    if (on)                                                                    \
+      printf(__VA_ARGS__);                                                     \
+  } while (0)
+
+#define PRINT_DEBUG(...) PRINT_DEBUG_IF(debug_trace, __VA_ARGS__)
+
 // Macro to quickly create an error
 #define ERR_CREATE(name, type, msg) Error(name) = {(type), (msg)}
 
@@ -61,6 +81,15 @@ typedef struct Error {
   char *msg; // Error msg (NULL if no error)
 } Error;
 
+/* A source file in memory */
+typedef struct File_t {
+  size_t file_size;
+  char *file_contents; // '\0' terminated
+  bool mapped;         // True if file_contents is an mmap'ed view
+  uint64_t hash;       // FNV-1a hash of the contents
+
+} File_t;
+
 static Error err_ok = {.error_type = NONE, .msg = NULL};
 
 /*****************************************************************************/
@@ -69,6 +98,10 @@ static Error err_ok = {.error_type = NONE, .msg = NULL};
 
 char *file_open_read(char *filename);
 size_t file_size_name(char *filename);
+File_t *file_map_read(char *filename);
+void file_unmap(File_t *file);
+uint64_t hash_fnv1a(const char *bytes, size_t len);
+uint64_t hash_fnv1a_update(uint64_t hash, const char *bytes, size_t len);
 void print_usage(void);
 
 #endif // UTIL_H_
@@ -0,0 +1,31 @@
+#ifndef WRITER_H_
+#define WRITER_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*****************************************************************************/
+/*                              Buffered output                              */
+/*****************************************************************************/
+
+#define WRITER_BUFFER_SIZE 8192
+
+/* Collects output in memory and hands it to the stream in large chunks */
+typedef struct Writer {
+  FILE *out;
+  size_t len; // Bytes of buf waiting to be written
+  char buf[WRITER_BUFFER_SIZE];
+} Writer;
+
+void writer_init(Writer *writer, FILE *out);
+void writer_write(Writer *writer, const char *bytes, size_t len);
+void writer_puts(Writer *writer, const char *str);
+void writer_printf(Writer *writer, const char *format, ...);
+void writer_vprintf(Writer *writer, const char *format, va_list args);
+/* Writes two spaces per level */
+void writer_indent(Writer *writer, size_t levels);
+/* Writes out everything buffered so far */
+void writer_flush(Writer *writer);
+
+#endif // WRITER_H_
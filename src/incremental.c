@@ -0,0 +1,647 @@
+#include "include/incremental.h"
+#include "include/mem.h"
+#include "include/util.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+/*                                 Documents                                 */
+/*****************************************************************************/
+
+/* Lexes and parses the whole source from scratch */
+static void document_parse(Document *doc) {
+  doc->diag = diagnostics_create(DIAGNOSTICS_DEFAULT_MAX);
+
+  doc->lexer = lexer_init(doc->source, doc->source_len);
+  doc->lexer->diag = doc->diag;
+  lexer_lex(doc->lexer);
+
+  doc->parser = init_parser(doc->lexer);
+  doc->parser->diag = doc->diag;
+  doc->program = parse_program(doc->parser);
+}
+
+/* Frees everything document_parse made */
+static void document_unparse(Document *doc) {
+  ast_destroy(doc->program);
+  parser_destroy(doc->parser);
+  lexer_destroy(doc->lexer);
+  diagnostics_destroy(doc->diag);
+
+  doc->program = NULL;
+  doc->parser = NULL;
+  doc->lexer = NULL;
+  doc->diag = NULL;
+}
+
+/* Frees the last good version, if one is kept */
+static void document_drop_good(Document *doc) {
+  if (doc->good_source == NULL) {
+    return;
+  }
+
+  ast_destroy(doc->good_program);
+  lexer_destroy(doc->good_lexer);
+  mem_free(MEM_SOURCE, doc->good_source, doc->good_len + 1);
+
+  doc->good_source = NULL;
+  doc->good_len = 0;
+  doc->good_lexer = NULL;
+  doc->good_program = NULL;
+}
+
+/* Keeps source, which parsed cleanly before the edit that broke it */
+static void document_keep_good(Document *doc, char *source, size_t len) {
+  doc->good_source = source;
+  doc->good_len = len;
+  doc->good_lexer = lexer_init(source, len);
+  lexer_lex(doc->good_lexer);
+
+  Parser *parser = init_parser(doc->good_lexer);
+  doc->good_program = parse_program(parser);
+  parser_destroy(parser);
+}
+
+Document *document_create(const char *source, size_t len) {
+  Document *doc = mem_alloc(MEM_MISC, sizeof(Document));
+
+  doc->source = mem_alloc(MEM_SOURCE, len + 1);
+  memcpy(doc->source, source, len);
+  doc->source_len = len;
+
+  document_parse(doc);
+  return doc;
+}
+
+size_t document_error_count(Document *doc) {
+  return diagnostics_count(doc->diag);
+}
+
+AST_t *document_last_good(Document *doc) {
+  return (document_error_count(doc) == 0) ? doc->program : doc->good_program;
+}
+
+void document_destroy(Document *doc) {
+  if (doc == NULL) {
+    return;
+  }
+
+  document_unparse(doc);
+  document_drop_good(doc);
+  mem_free(MEM_SOURCE, doc->source, doc->source_len + 1);
+  mem_free(MEM_MISC, doc, sizeof(Document));
+}
+
+/*****************************************************************************/
+/*                                 Re-lexing                                 */
+/*****************************************************************************/
+
+/* Index of the first token whose lexeme ends at or after offset */
+static size_t first_token_ending_from(array_T *tokens, size_t offset) {
+  size_t lo = 0;
+  size_t hi = tokens->size;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (token_lexeme_end(tokens->items[mid]) < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+/* Index of the token starting exactly at offset, or tokens->size */
+static size_t token_at_offset(array_T *tokens, size_t offset, size_t from) {
+  size_t lo = from;
+  size_t hi = tokens->size;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    Token *token = tokens->items[mid];
+    if (token->offset < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < tokens->size && ((Token *)tokens->items[lo])->offset == offset) {
+    return lo;
+  }
+  return tokens->size;
+}
+
+static bool same_lexeme(Token *a, Token *b) {
+  return a->type == b->type && a->len == b->len &&
+         memcmp(a->str, b->str, a->len) == 0;
+}
+
+static void token_list_pop_destroy(array_T *tokens) {
+  token_destroy(tokens->items[tokens->size - 1]);
+  tokens->size--;
+}
+
+/* What relexing changed, in old token indices */
+typedef struct Relex {
+  size_t prefix;   // Old tokens [0, prefix) were kept untouched
+  size_t resync;   // Old tokens [resync, size) were kept, shifted
+  size_t inserted; // Number of new tokens between them
+} Relex;
+
+/* Re-lexes the edited region of new_source and splices the result into the
+   lexer's token list. Lexing stops as soon as a new token lines up with an
+   old one past the edit, since the rest of the stream must then match. */
+static Relex relex(Document *doc, Edit edit, char *new_source,
+                   size_t new_len) {
+  array_T *old = doc->lexer->token_list;
+  long delta = (long)edit.new_len - (long)edit.old_len;
+
+  // Tokens ending before the edit cannot change. Lexing restarts at the last
+  // of them, which gives a known line position to start from.
+  size_t keep = first_token_ending_from(old, edit.start);
+  size_t prefix = keep > 0 ? keep - 1 : 0;
+
+  Lexer lexer = {0};
+  lexer.source = new_source;
+  lexer.source_len = new_len;
+  lexer.token_list = array_create(sizeof(Token *));
+  lexer.diag = doc->diag;
+  lexer.trace = doc->lexer->trace;
+
+  if (keep > 0) {
+    Token *from = old->items[prefix];
+    lexer.cursor = from->offset;
+    lexer.line_position.line = from->pos.line;
+    lexer.line_start = from->offset - from->pos.x;
+  }
+
+  size_t resync = old->size;
+  Token *token;
+
+  while ((token = lexer_next_token(&lexer)) != NULL) {
+    // Identical to the next old token in front of the edit
+    if (lexer.token_list->size == 1 && token->offset < edit.start &&
+        prefix < old->size && token_equal(token, old->items[prefix])) {
+      token_list_pop_destroy(lexer.token_list);
+      prefix++;
+      continue;
+    }
+
+    if (token->offset < edit.start + edit.new_len) {
+      continue;
+    }
+
+    size_t match = token_at_offset(old, token->offset - delta, prefix);
+    if (match == old->size || !same_lexeme(token, old->items[match])) {
+      continue;
+    }
+
+    // Back in step: shift the rest of the old stream into place
+    Token *sync = old->items[match];
+    size_t sync_line = sync->pos.line;
+    long line_delta = (long)token->pos.line - (long)sync->pos.line;
+    long x_delta = (long)token->pos.x - (long)sync->pos.x;
+
+    for (size_t i = match; i < old->size; i++) {
+      Token *shifted = old->items[i];
+      if (shifted->pos.line == sync_line) {
+        shifted->pos.x += x_delta;
+      }
+      shifted->pos.line += line_delta;
+      shifted->offset += delta;
+    }
+
+    token_list_pop_destroy(lexer.token_list);
+    resync = match;
+    break;
+  }
+
+  // Splice old prefix + new tokens + old suffix
+  array_T *tokens = array_create(sizeof(Token *));
+  for (size_t i = 0; i < prefix; i++) {
+    array_push(tokens, old->items[i]);
+  }
+  for (size_t i = 0; i < lexer.token_list->size; i++) {
+    array_push(tokens, lexer.token_list->items[i]);
+  }
+  for (size_t i = resync; i < old->size; i++) {
+    array_push(tokens, old->items[i]);
+  }
+  for (size_t i = prefix; i < resync; i++) {
+    token_destroy(old->items[i]);
+  }
+
+  Relex result = {prefix, resync, lexer.token_list->size};
+
+  array_destroy(lexer.token_list);
+  array_destroy(old);
+  doc->lexer->token_list = tokens;
+
+  return result;
+}
+
+/*****************************************************************************/
+/*                                Re-parsing                                 */
+/*****************************************************************************/
+
+/* Re-parses the top-level declarations the relexed tokens fall in, reusing
+   every other declaration's subtree */
+static void reparse(Document *doc, Relex changed, EditStats *stats) {
+  array_T *decls = doc->program->children;
+  long shift = (long)changed.inserted - (long)(changed.resync - changed.prefix);
+
+  // A declaration is affected if it overlaps the changed tokens, or if the
+  // first changed token is the one it looked ahead at (`else`)
+  size_t first = 0;
+  while (first < decls->size &&
+         ((AST_t *)decls->items[first])->token_end < changed.prefix) {
+    first++;
+  }
+
+  size_t next = first;
+  while (next < decls->size &&
+         ((AST_t *)decls->items[next])->token_start < changed.resync) {
+    next++;
+  }
+
+  size_t start = changed.prefix;
+  size_t end = changed.resync;
+  if (next > first) {
+    AST_t *first_decl = decls->items[first];
+    AST_t *last_decl = decls->items[next - 1];
+    if (first_decl->token_start < start) {
+      start = first_decl->token_start;
+    }
+    if (last_decl->token_end > end) {
+      end = last_decl->token_end;
+    }
+  }
+  end += shift;
+
+  array_T *parsed = array_create(sizeof(AST_t *));
+  Parser *parser = doc->parser;
+  parser->lexer = doc->lexer;
+  parser_seek(parser, start);
+
+  while (parser->index < end && parser->token->type != TOKEN_EOF) {
+    size_t decl_start = parser->index;
+    AST_t *decl = parse_declaration(parser);
+    if (decl != NULL) {
+      decl->token_start = decl_start;
+      decl->token_end = parser->index;
+    }
+    array_push(parsed, decl);
+
+    // A declaration that ran on swallows the ones it ran into
+    while (next < decls->size &&
+           ((AST_t *)decls->items[next])->token_start + shift < parser->index) {
+      end = ((AST_t *)decls->items[next])->token_end + shift;
+      next++;
+    }
+  }
+
+  array_T *children = array_create(sizeof(AST_t *));
+  for (size_t i = 0; i < first; i++) {
+    array_push(children, decls->items[i]);
+  }
+  for (size_t i = 0; i < parsed->size; i++) {
+    array_push(children, parsed->items[i]);
+  }
+  for (size_t i = next; i < decls->size; i++) {
+    AST_t *decl = decls->items[i];
+    decl->token_start += shift;
+    decl->token_end += shift;
+    array_push(children, decl);
+  }
+  for (size_t i = first; i < next; i++) {
+    ast_destroy(decls->items[i]);
+  }
+
+  stats->decls_reparsed = parsed->size;
+  stats->decls_reused = decls->size - (next - first);
+
+  array_destroy(parsed);
+  array_destroy(decls);
+  doc->program->children = children;
+}
+
+EditStats document_edit(Document *doc, Edit edit) {
+  EditStats stats = {0, 0, 0, 0};
+  assert(edit.start + edit.old_len <= doc->source_len && "Edit out of range");
+  bool was_clean = document_error_count(doc) == 0;
+
+  size_t tail = doc->source_len - edit.start - edit.old_len;
+  size_t new_len = edit.start + edit.new_len + tail;
+  char *source = mem_alloc(MEM_SOURCE, new_len + 1);
+  memcpy(source, doc->source, edit.start);
+  memcpy(source + edit.start, edit.text, edit.new_len);
+  memcpy(source + edit.start + edit.new_len,
+         doc->source + edit.start + edit.old_len, tail);
+
+  char *old_source = doc->source;
+  size_t old_len = doc->source_len;
+  doc->source = source;
+  doc->source_len = new_len;
+
+  if (was_clean) {
+    Relex changed = relex(doc, edit, source, new_len);
+
+    doc->lexer->source = source;
+    doc->lexer->source_len = new_len;
+    doc->lexer->cursor = new_len + 1; // Still fully lexed
+
+    stats.tokens_relexed = changed.inserted;
+    stats.tokens_reused = doc->lexer->token_list->size - changed.inserted;
+
+    if (changed.inserted == 0 && changed.resync == changed.prefix) {
+      // Only whitespace or comments changed, the tree is still right
+      stats.decls_reused = doc->program->children->size;
+    } else if (document_error_count(doc) == 0) {
+      reparse(doc, changed, &stats);
+    }
+
+    if (document_error_count(doc) == 0) {
+      mem_free(MEM_SOURCE, old_source, old_len + 1);
+      return stats;
+    }
+  }
+
+  // Errors depend on everything parsed before them, so they are only right
+  // from a full parse
+  document_unparse(doc);
+  document_parse(doc);
+  stats.tokens_relexed = doc->lexer->token_list->size;
+  stats.tokens_reused = 0;
+  stats.decls_reparsed = doc->program->children->size;
+  stats.decls_reused = 0;
+
+  if (document_error_count(doc) == 0) {
+    document_drop_good(doc);
+    mem_free(MEM_SOURCE, old_source, old_len + 1);
+  } else if (was_clean) {
+    document_keep_good(doc, old_source, old_len);
+  } else {
+    mem_free(MEM_SOURCE, old_source, old_len + 1);
+  }
+
+  return stats;
+}
+
+/*****************************************************************************/
+/*                                  Fuzzing                                  */
+/*****************************************************************************/
+
+static unsigned fuzz_state;
+
+static unsigned fuzz_rand(void) {
+  // xorshift32
+  fuzz_state ^= fuzz_state << 13;
+  fuzz_state ^= fuzz_state >> 17;
+  fuzz_state ^= fuzz_state << 5;
+  return fuzz_state;
+}
+
+static Token *doc_token(Document *doc, size_t i) {
+  return doc->lexer->token_list->items[i];
+}
+
+/* Picks a random token of the given type, or returns false */
+static bool fuzz_pick(Document *doc, TokenType type, size_t *out) {
+  array_T *tokens = doc->lexer->token_list;
+  size_t count = 0;
+
+  for (size_t i = 0; i < tokens->size; i++) {
+    if (doc_token(doc, i)->type == type) {
+      count++;
+    }
+  }
+  if (count == 0) {
+    return false;
+  }
+
+  size_t pick = fuzz_rand() % count;
+  for (size_t i = 0; i < tokens->size; i++) {
+    if (doc_token(doc, i)->type == type && pick-- == 0) {
+      *out = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Builds a random edit. Most keep the program valid so the incremental path
+   gets exercised; the rest break it the way typing does. */
+static bool fuzz_edit(Document *doc, Edit *edit, char *buffer) {
+  static char *spaces[] = {" ", "\n", "\t", "// note\n", "\n\n"};
+  static char *operators[] = {"+", "-", "*", "/", "<", ">"};
+  static char *partial[] = {"(", ")", "{", "}", ";", "\"", "fun", "var x =",
+                            "print", ".", "@", "if ("};
+  array_T *tokens = doc->lexer->token_list;
+  array_T *decls = doc->program->children;
+  size_t i;
+
+  edit->old_len = 0;
+  edit->text = buffer;
+
+  // Undo back to the last good version half the time, so most edits are
+  // made to a clean source and take the incremental path
+  if (doc->good_source != NULL && fuzz_rand() % 2 == 0) {
+    edit->start = 0;
+    edit->old_len = doc->source_len;
+    edit->text = doc->good_source;
+    edit->new_len = doc->good_len;
+    return true;
+  }
+
+  switch (fuzz_rand() % 9) {
+  case 0: { // Whitespace or a comment in front of any token
+    edit->start = doc_token(doc, fuzz_rand() % tokens->size)->offset;
+    strcpy(buffer, spaces[fuzz_rand() % 5]);
+    break;
+  }
+  case 1: { // Rename an identifier
+    if (!fuzz_pick(doc, TOKEN_IDENTIFIER, &i)) {
+      return false;
+    }
+    edit->start = doc_token(doc, i)->offset;
+    edit->old_len = doc_token(doc, i)->len;
+    snprintf(buffer, 32, "v_%c%u", 'a' + fuzz_rand() % 26, fuzz_rand() % 100);
+    break;
+  }
+  case 2: { // Change a number
+    if (!fuzz_pick(doc, TOKEN_NUMBER, &i)) {
+      return false;
+    }
+    edit->start = doc_token(doc, i)->offset;
+    edit->old_len = doc_token(doc, i)->len;
+    snprintf(buffer, 32, "%u", fuzz_rand() % 1000);
+    break;
+  }
+  case 3: { // Swap a binary operator
+    TokenType types[] = {TOKEN_PLUS, TOKEN_STAR, TOKEN_SLASH, TOKEN_LESS,
+                         TOKEN_GREATER};
+    if (!fuzz_pick(doc, types[fuzz_rand() % 5], &i)) {
+      return false;
+    }
+    edit->start = doc_token(doc, i)->offset;
+    edit->old_len = doc_token(doc, i)->len;
+    strcpy(buffer, operators[fuzz_rand() % 6]);
+    break;
+  }
+  case 4: { // Add a statement after another one
+    if (!fuzz_pick(doc, TOKEN_SEMICOLON, &i) ||
+        doc_token(doc, i + 1)->type == TOKEN_ELSE) {
+      return false;
+    }
+    edit->start = token_lexeme_end(doc_token(doc, i));
+    strcpy(buffer, "\n  print 1 + v_x;");
+    break;
+  }
+  case 5: { // Add a function between two declarations
+    size_t at = fuzz_rand() % (decls->size + 1);
+    size_t token = (at < decls->size && decls->items[at] != NULL)
+                       ? ((AST_t *)decls->items[at])->token_start
+                       : tokens->size - 1;
+    edit->start = doc_token(doc, token)->offset;
+    strcpy(buffer, "fun v_f(a) {\n  return a(a);\n}\n");
+    break;
+  }
+  case 6: { // Remove a declaration
+    if (decls->size == 0) {
+      return false;
+    }
+    AST_t *decl = decls->items[fuzz_rand() % decls->size];
+    if (decl == NULL || decl->token_end <= decl->token_start) {
+      return false;
+    }
+    edit->start = doc_token(doc, decl->token_start)->offset;
+    edit->old_len =
+        token_lexeme_end(doc_token(doc, decl->token_end - 1)) - edit->start;
+    buffer[0] = '\0';
+    break;
+  }
+  case 7: { // Type something incomplete in front of any token
+    edit->start = doc_token(doc, fuzz_rand() % tokens->size)->offset;
+    strcpy(buffer, partial[fuzz_rand() % 12]);
+    break;
+  }
+  case 8: { // Delete a token
+    i = fuzz_rand() % tokens->size;
+    if (doc_token(doc, i)->type == TOKEN_EOF) {
+      return false;
+    }
+    edit->start = doc_token(doc, i)->offset;
+    edit->old_len = doc_token(doc, i)->len;
+    buffer[0] = '\0';
+    break;
+  }
+  }
+
+  edit->new_len = strlen(buffer);
+  return true;
+}
+
+/* Compares a document with a fresh lex and parse of its source */
+static bool document_check(Document *doc) {
+  Diagnostics *diag = diagnostics_create(DIAGNOSTICS_DEFAULT_MAX);
+  Lexer *lexer = lexer_init(doc->source, doc->source_len);
+  lexer->diag = diag;
+  lexer_lex(lexer);
+  Parser *parser = init_parser(lexer);
+  parser->diag = diag;
+  AST_t *program = parse_program(parser);
+
+  array_T *a = doc->lexer->token_list;
+  array_T *b = lexer->token_list;
+  bool same = a->size == b->size;
+
+  for (size_t i = 0; same && i < a->size; i++) {
+    if (!token_equal(a->items[i], b->items[i])) {
+      PRINT_ERROR("Token %zu differs: `%s` vs `%s`", i,
+                  ((Token *)a->items[i])->str, ((Token *)b->items[i])->str);
+      same = false;
+    }
+  }
+
+  if (same && !ast_equal(doc->program, program)) {
+    PRINT_ERROR("%s", "Incremental AST differs from a full parse");
+    same = false;
+  }
+
+  if (same && document_error_count(doc) != diagnostics_count(diag)) {
+    PRINT_ERROR("%zu error(s), a full parse finds %zu",
+                document_error_count(doc), diagnostics_count(diag));
+    same = false;
+  }
+
+  // The fuzzer starts from a clean file, so there is always a good version
+  if (same && document_last_good(doc) == NULL) {
+    PRINT_ERROR("%s", "Lost the last good tree");
+    same = false;
+  }
+
+  ast_destroy(program);
+  parser_destroy(parser);
+  lexer_destroy(lexer);
+  diagnostics_destroy(diag);
+  return same;
+}
+
+bool test_incremental(char *filename, size_t iterations, unsigned seed) {
+  File_t *file = file_map_read(filename);
+  if (file == NULL) {
+    return false;
+  }
+
+  Document *doc = document_create(file->file_contents, file->file_size);
+  file_unmap(file);
+
+  if (document_error_count(doc) > 0) {
+    PRINT_ERROR("`%s` must parse cleanly to be fuzzed", filename);
+    document_destroy(doc);
+    return false;
+  }
+
+  fuzz_state = seed ? seed : 1;
+  char buffer[64];
+  size_t done = 0;
+  size_t broken = 0; // Edits that left the source with errors
+  bool ok = true;
+
+  while (done < iterations) {
+    Edit edit;
+    if (!fuzz_edit(doc, &edit, buffer)) {
+      continue;
+    }
+
+    EditStats stats = document_edit(doc, edit);
+    done++;
+    broken += document_error_count(doc) > 0;
+
+    if (!document_check(doc)) {
+      PRINT_ERROR("Mismatch after edit %zu: %zu bytes at %zu -> `%s`", done,
+                  edit.old_len, edit.start, buffer);
+      ok = false;
+      break;
+    }
+
+    PRINT_TRACE("Edit %zu: relexed %zu, reused %zu tokens; reparsed %zu, "
+                "reused %zu declarations",
+                done, stats.tokens_relexed, stats.tokens_reused,
+                stats.decls_reparsed, stats.decls_reused);
+  }
+
+  fprintf(stderr,
+          "Incremental fuzzing (seed %u): %zu/%zu edits matched a full parse, "
+          "%zu left errors\n",
+          seed ? seed : 1, ok ? done : done - 1, iterations, broken);
+
+  document_destroy(doc);
+  return ok;
+}
@@ -1,5 +1,6 @@
 #include "include/lexer.h"
 #include "include/list.h"
+#include "include/mem.h"
 #include "include/util.h"
 #include <assert.h>
 #include <ctype.h>
@@ -41,10 +42,10 @@ void scan(Lexer *lexer);
 
 Lexer *lexer_init(char *source, size_t sourcelen) {
 
-  printf("\n\nInitialising lexer.\n\n");
+  PRINT_DEBUG("\n\nInitialising lexer.\n\n");
 
   Lexer *lexer;
-  lexer = calloc(1, sizeof(Lexer)); // Create our lexer struct
+  lexer = mem_alloc(MEM_LEXER, sizeof(Lexer)); // Create our lexer struct
 
   /* lexer->tokens = create_tokenlist(); // List structure where we store our *
    * tokens */
@@ -52,12 +53,14 @@ Lexer *lexer_init(char *source, size_t sourcelen) {
   lexer->source = source;        // Assigning our source
   lexer->source_len = sourcelen; // The source length
 
-  printf("\n\nSource is: \n\n'%s'\n\nSource length is '%zu'", lexer->source,
-         lexer->source_len);
+  PRINT_DEBUG("\n\nSource is: \n\n'%s'\n\nSource length is '%zu'",
+              lexer->source, lexer->source_len);
 
   lexer->cursor = 0; // Where we are in the overall source
   lexer->line_position.line = 0;
   lexer->line_position.x = 0;
+  lexer->line_start = 0;
+  lexer->trace = debug_trace;
 
   return lexer;
 }
@@ -69,7 +72,9 @@ char lexer_advance(Lexer *lexer) {
   }
 
   lexer->cursor++;
-  lexer->line_position.x++;
+  if (LEXER_SOURCE_FINISHED(lexer)) {
+    return 0; // Stepped past the '\0', which is the last byte we own
+  }
   return lexer->source[lexer->cursor];
 }
 
@@ -88,7 +93,7 @@ static inline bool identifier_continuing(char c) {
 static char peek_next_char(Lexer *lexer, size_t curr_pos) {
 
   if (LEXER_SOURCE_FINISHED(lexer)) {
-    PRINT_TRACE("%sPeeking cancelled.", " ");
+    PRINT_TRACE_IF(lexer->trace, "%sPeeking cancelled.", " ");
     return '\0';
   }
 
@@ -125,13 +130,13 @@ void tokenize_identifier(Lexer *lexer) {
 
   char c = lexer->source[cursPos];
 
-  PRINT_TRACE("Curr char: '%c'", c);
+  PRINT_TRACE_IF(lexer->trace, "Curr char: '%c'", c);
 
   // identifier = daga42
   // continues until char is neither alphanumerical or `_`
   while (identifier_starting(peek) || isdigit(peek)) {
 
-    printf("[tokenize_identifier] '%c' \n", peek);
+    PRINT_DEBUG_IF(lexer->trace, "[tokenize_identifier] '%c' \n", peek);
     end++;
     cursPos++;
     peek = peek_next_char(lexer, cursPos);
@@ -151,25 +156,46 @@ void tokenize_string_literal(Lexer *lexer) {
 
   size_t startPos = lexer->cursor;
   size_t i = startPos;
-
-  while (peek_next_char(lexer, i) != '"' && !LEXER_SOURCE_FINISHED(lexer)) {
-    if (peek_next_char(lexer, i) == '\n' || peek_next_char(lexer, i) == '\r') {
-      lexer->line_position.line++;
-      lexer->line_position.x = 0;
+  // The token is positioned where it starts, so newlines inside the string
+  // are only applied to the lexer once it has been inserted
+  size_t newlines = 0;
+  size_t nextLineStart = lexer->line_start;
+
+  while (i + 1 < lexer->source_len && peek_next_char(lexer, i) != '"') {
+    // Lines end as they do outside strings: `\n`, or `\r` on its own
+    char c = peek_next_char(lexer, i);
+    if (c == '\n' || (c == '\r' && peek_next_char(lexer, i + 1) != '\n')) {
+      newlines++;
+      nextLineStart = i + 2;
     }
     i++;
     end++;
   }
 
-  if ((i >= lexer->source_len) || (lexer->source[i] == '\0')) {
-    PRINT_ERROR("%s on line %zu", "Unterminated string!",
-                lexer->line_position.line);
-    exit(1);
+  if (i + 1 >= lexer->source_len) {
+    LinePosition pos = lexer->line_position;
+    pos.x = startPos - 1 - lexer->line_start;
+    diagnostics_report(lexer->diag, SYNTAX, startPos - 1, lexer->source_len,
+                       pos, "%s", "Unterminated string");
+
+    // The rest of the file is inside the string, so skip to the end of it
+    lexer->line_position.line += newlines;
+    lexer->line_start = nextLineStart;
+    lexer->cursor = lexer->source_len - 1;
+    return;
   }
 
   lexer_advance(lexer); // Trims leading `"`
 
   tokenlist_insert(lexer, TOKEN_STRING, start, end);
+
+  // Position the token at its opening quote
+  Token *token = lexer->token_list->items[lexer->token_list->size - 1];
+  token->offset--;
+  token->pos.x--;
+
+  lexer->line_position.line += newlines;
+  lexer->line_start = nextLineStart;
 }
 
 void tokenize_number_literal(Lexer *lexer) {
@@ -185,7 +211,8 @@ void tokenize_number_literal(Lexer *lexer) {
 
   // Scanning through the numbers
   while (isdigit(peek_next_char(lexer, i))) {
-    printf("i: %zu, lex->cursor: %zu\n", i, lexer->cursor);
+    PRINT_DEBUG_IF(lexer->trace, "i: %zu, lex->cursor: %zu\n", i,
+                   lexer->cursor);
     i++;
     end++;
   }
@@ -196,7 +223,8 @@ void tokenize_number_literal(Lexer *lexer) {
     i++;
     end++;
     while (isdigit(peek_next_char(lexer, i))) {
-      printf("i: %zu, lex->cursor: %zu\n", i, lexer->cursor);
+      PRINT_DEBUG_IF(lexer->trace, "i: %zu, lex->cursor: %zu\n", i,
+                   lexer->cursor);
       i++;
       end++;
     }
@@ -211,33 +239,34 @@ void tokenize_number_literal(Lexer *lexer) {
 void tokenlist_insert(Lexer *lexer, TokenType type, const char *beg,
                       const char *end) {
 
-  printf("\n\n---ADDING NEW TOKEN:---\n");
-  PRINT_TRACE("TOKEN STRING:-> `%.*s`\nTOKEN LENGTH: `%zu`",
-              (int)(end - beg + 1), beg, end - beg + 1);
+  PRINT_DEBUG_IF(lexer->trace, "\n\n---ADDING NEW TOKEN:---\n");
+  PRINT_TRACE_IF(lexer->trace, "TOKEN STRING:-> `%.*s`\nTOKEN LENGTH: `%zu`",
+                 (int)(end - beg + 1), beg, end - beg + 1);
 
   // Creating Token
-  Token *token = calloc(1, sizeof(Token));
-  assert((token != NULL) && "Malloc failed.");
+  Token *token = mem_alloc(MEM_TOKEN, sizeof(Token));
   token->type = type;
+  token->offset = (size_t)(beg - lexer->source);
+  lexer->line_position.x = token->offset - lexer->line_start;
   token->pos.line = lexer->line_position.line;
   token->pos.x = lexer->line_position.x;
 
   // Length of token string
   size_t tokenLength = ((end - beg) + 1);
   // Allocating memory for the string
-  char *tokenString = calloc(tokenLength, sizeof(char));
+  char *tokenString = mem_alloc(MEM_TOKEN_STRING, tokenLength + 1);
   // Null terminating
   tokenString[tokenLength] = '\0';
   // Copying string
   memcpy(tokenString, beg, tokenLength);
-  printf("Mem copied string: `%s`", tokenString);
+  PRINT_DEBUG_IF(lexer->trace, "Mem copied string: `%s`", tokenString);
   token->len = tokenLength;
   token->str = tokenString;
 
   if (*beg == '\0' || 0) {
     token->type = TOKEN_EOF;
     array_push(lexer->token_list, token);
-    PRINT_TRACE("%s", "End of source. Exiting.");
+    PRINT_TRACE_IF(lexer->trace, "%s", "End of source. Exiting.");
     return;
   }
 
@@ -246,7 +275,7 @@ void tokenlist_insert(Lexer *lexer, TokenType type, const char *beg,
     for (size_t i = 0; i < KW_COUNT; i++) {
       if (strcmp(tokenString, kw[i].word) == 0) {
         token->type = kw[i].token_type;
-        printf("KEYWORD FOUND: %s\n\n", kw[i].word);
+        PRINT_DEBUG_IF(lexer->trace, "KEYWORD FOUND: %s\n\n", kw[i].word);
       }
     }
   }
@@ -274,11 +303,12 @@ void lx_src_skip_whitespace(Lexer *lexer) {
   return;
 }
 
-/* Skips a comment line */
+/* Skips a comment line, up to the `\n` or `\r` that ends it */
 void lx_src_skip_comment(Lexer *lexer) {
 
   size_t i = lexer->cursor;
-  while (!(LEXER_SOURCE_FINISHED(lexer)) && peek_next_char(lexer, i) != '\n') {
+  while (i + 1 < lexer->source_len && peek_next_char(lexer, i) != '\n' &&
+         peek_next_char(lexer, i) != '\r') {
     ++i;
   }
 
@@ -295,35 +325,33 @@ void scan(Lexer *lexer) {
 
   const char *beg = &lexer->source[lexer->cursor]; // Current char
 
-  PRINT_TRACE("Scanning char: `%c`", *beg);
+  PRINT_TRACE_IF(lexer->trace, "Scanning char: `%c`", *beg);
 
   switch (*beg) {
   case 0: {
-    printf("!!!---End of file reached---!!!");
+    PRINT_DEBUG_IF(lexer->trace, "!!!---End of file reached---!!!");
     tokenlist_insert(lexer, TOKEN_EOF, beg, beg);
     break;
   }
 
     /* Whitespace ************************************************************/
-  case ' ': {
-    lexer->line_position.x++;
-    break;
-  }
-  // FIXME Currently a tab width is only considered to be 1 space.
+  // NOTE Columns are byte offsets into the line, so a tab is 1 column.
+  case ' ':
   case '\t': {
-    lexer->line_position.x++;
     break;
   }
-    // Carriage return
+    // Carriage return (on its own, `\r\n` is counted at the `\n`)
   case '\r': {
-    lexer->line_position.x = 0;
-    lexer->line_position.line++;
+    if (!matches_next_char(lexer, '\n')) {
+      lexer->line_position.line++;
+      lexer->line_start = lexer->cursor + 1;
+    }
     break;
   }
     // New line
   case '\n': {
-    lexer->line_position.x = 0;
     lexer->line_position.line++;
+    lexer->line_start = lexer->cursor + 1;
     break;
   }
 
@@ -420,8 +448,10 @@ void scan(Lexer *lexer) {
     }
 
     // If nothing matches...
-    // TODO handle if nothing matches
-    PRINT_TRACE("Invalid character: %c", *beg);
+    LinePosition pos = lexer->line_position;
+    pos.x = lexer->cursor - lexer->line_start;
+    diagnostics_report(lexer->diag, SYNTAX, lexer->cursor, lexer->cursor + 1,
+                       pos, "Unexpected character `%c`", *beg);
     break;
   }
 }
@@ -466,34 +496,50 @@ void tokenlist_print(Lexer *lexer) {
   printf("-----------------------------------------------\n\n");
 }
 
-void token_destroy(void *tkn) {
-  Token *token = (Token *)tkn;
-  free((void *)token->str);
-}
-
+/* Frees the lexer and all of its tokens. The source belongs to the caller. */
 void lexer_destroy(Lexer *lex) {
-  PRINT_TRACE("Destroying the lexer! %s", "");
-  free((void *)lex->source);
+  bool trace = lex->trace;
+  PRINT_TRACE_IF(trace, "Destroying the lexer! %s", "");
 
   // Freeing all mem from tokens
-  /* tknlist_foreach(lex->tokens, token_destroy); */
-  /* tknlist_foreach(lex->tokens, free); */
-  /* free(lex->tokens); */
-  free(lex);
-  PRINT_TRACE("%s", "Lexer destroyed.");
+  for (size_t i = 0; i < lex->token_list->size; i++) {
+    token_destroy(lex->token_list->items[i]);
+  }
+  array_destroy(lex->token_list);
+
+  mem_free(MEM_LEXER, lex, sizeof(Lexer));
+  PRINT_TRACE_IF(trace, "%s", "Lexer destroyed.");
 }
 
 void lexer_lex(Lexer *lexer) {
   /* printf("Contents: \n\n------\n%s\n-------\n\n", lexer->source); */
 
   while (!LEXER_SOURCE_FINISHED(lexer)) {
-    printf("\nScanning char: `%c`\tCursor val: `%zu`\n",
-           lexer->source[lexer->cursor], lexer->cursor);
+    PRINT_DEBUG_IF(lexer->trace, "\nScanning char: `%c`\tCursor val: `%zu`\n",
+                   lexer->source[lexer->cursor], lexer->cursor);
+    scan(lexer);
+    lexer_advance(lexer);
+  }
+
+  if (lexer->trace) {
+    tokenlist_print(lexer);
+  }
+}
+
+/* Lexes until the next token has been added and returns it, or NULL once the
+   source is finished */
+Token *lexer_next_token(Lexer *lexer) {
+  size_t count = lexer->token_list->size;
+
+  while (!LEXER_SOURCE_FINISHED(lexer)) {
     scan(lexer);
     lexer_advance(lexer);
+    if (lexer->token_list->size > count) {
+      return lexer->token_list->items[lexer->token_list->size - 1];
+    }
   }
 
-  tokenlist_print(lexer);
+  return NULL;
 }
 
 // NOTE: Ignore this function
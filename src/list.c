@@ -1,4 +1,5 @@
 #include "include/list.h"
+#include "include/mem.h"
 #include "include/util.h"
 #include <assert.h>
 #include <stdio.h>
@@ -11,9 +12,10 @@
 
 array_T *array_create(size_t item_size) {
 
-  array_T *array = calloc(1, sizeof(array_T));
+  array_T *array = mem_alloc(MEM_ARRAY, sizeof(array_T));
 
   array->size = 0;
+  array->capacity = 0;
   array->item_size = item_size;
 
   return array;
@@ -27,20 +29,29 @@ void array_push(array_T *array, void *item) {
     return;
   }
 
-  array->size += 1;
-
-  if (!array->items) {
-    array->items = calloc(1, array->item_size);
-  } else {
+  // Grow geometrically so pushing n items costs O(n) copies
+  if (array->size == array->capacity) {
+    size_t capacity = array->capacity < 8 ? 8 : array->capacity * 2;
     array->items =
-        realloc(array->items, (array->size * sizeof(array->item_size)));
+        mem_realloc(MEM_ARRAY, array->items, array->capacity * sizeof(void *),
+                    capacity * sizeof(void *));
+    array->capacity = capacity;
   }
 
+  array->size += 1;
   array->items[array->size - 1] = item;
 }
 
-// TODO Implement this
-void array_destroy(array_T *array);
+// Frees the array itself, not the items it points to
+void array_destroy(array_T *array) {
+
+  if (array == NULL) {
+    return;
+  }
+
+  mem_free(MEM_ARRAY, array->items, array->capacity * sizeof(void *));
+  mem_free(MEM_ARRAY, array, sizeof(array_T));
+}
 
 /*****************************************************************************/
 /*                             Doubly linked list                            */
@@ -49,7 +60,7 @@ void array_destroy(array_T *array);
 /**
  *  \brief Creates a new doubly linked list and assigns it to the out argument.
  *
- *  This function creates a new list, allocating memory for it using malloc.
+ *  This function creates a new list, allocating memory for it using mem_alloc.
  *  Size is initialised as 0 and both head and tail will point to NULL.
  *
  *  \param out Where a reference to the list will be passed to.
@@ -57,13 +68,13 @@ void array_destroy(array_T *array);
  */
 void list_create(void **out) {
 
-  List_t *list = calloc(1, sizeof(List_t));
+  List_t *list = mem_alloc(MEM_LIST, sizeof(List_t));
   list->size = 0;
   list->head = NULL;
 
   list->tail = NULL;
 
-  printf("List created!");
+  PRINT_DEBUG("List created!");
 
   *out = list;
 }
@@ -98,8 +109,8 @@ void list_destroy(List_t *list) {
 
   // If head is null or the size is 0 then just free the List and return
   if (curr == NULL || list->size == 0) {
-    free(list);
-    printf("The list was empty! Freeing only the list itself.\n");
+    mem_free(MEM_LIST, list, sizeof(List_t));
+    PRINT_DEBUG("The list was empty! Freeing only the list itself.\n");
     return;
   }
   // Next node
@@ -109,7 +120,7 @@ void list_destroy(List_t *list) {
   // Free up all of the nodes
   while (curr) {
     free(curr->data);
-    free(curr);
+    mem_free(MEM_LIST, curr, sizeof(ListNode_t));
     counter++;
     curr = next;
     if (!curr->next) {
@@ -119,12 +130,12 @@ void list_destroy(List_t *list) {
   }
   // Free the tail
   free(list->tail->data);
-  free(list->tail);
+  mem_free(MEM_LIST, list->tail, sizeof(ListNode_t));
 
   counter++;
   fprintf(stdout, "%s: Freed %zu items.", __FUNCTION__, counter);
   // Finally free the list
-  free(list);
+  mem_free(MEM_LIST, list, sizeof(List_t));
 }
 
 void list_node_insert(List_t *list, void *data, void **out) {
@@ -132,7 +143,7 @@ void list_node_insert(List_t *list, void *data, void **out) {
   assert(list != NULL);
   assert(data != NULL);
 
-  ListNode_t *toInsert = malloc(sizeof(ListNode_t));
+  ListNode_t *toInsert = mem_alloc(MEM_LIST, sizeof(ListNode_t));
 
   toInsert->data = data;
   toInsert->next = NULL;
@@ -151,7 +162,7 @@ void list_node_insert(List_t *list, void *data, void **out) {
   }
 
   list->size++;
-  printf("New node added! New size: %zu\n", list->size);
+  PRINT_DEBUG("New node added! New size: %zu\n", list->size);
 
   if (out == NULL) {
     return;
@@ -167,13 +178,13 @@ void list_remove_head(List_t *list) {
   if (IS_NOT_NULL(list->head)) {
     newHead = list->head->next;
     newHead->previous = NULL;
-    free(list->head);
+    mem_free(MEM_LIST, list->head, sizeof(ListNode_t));
     list->size--;
-    printf("Head was removed. New size: %zu\n", list->size);
+    PRINT_DEBUG("Head was removed. New size: %zu\n", list->size);
     return;
 
   } else {
-    printf("Head was null!\n");
+    PRINT_DEBUG("Head was null!\n");
     return;
   }
 }
@@ -186,19 +197,19 @@ void list_remove_tail(List_t *list) {
   if (IS_NOT_NULL(list->tail)) {
     newTail = list->tail->next;
     newTail->previous = NULL;
-    free(list->tail);
-    printf("Tail was removed. New size: %zu\n", list->size);
+    mem_free(MEM_LIST, list->tail, sizeof(ListNode_t));
+    PRINT_DEBUG("Tail was removed. New size: %zu\n", list->size);
     list->size--;
 
   } else {
-    printf("tail was null!\n");
+    PRINT_DEBUG("tail was null!\n");
   }
 }
 
 void list_get_head(List_t *list, void **out) {
 
   if (list == NULL || list->size == 0) {
-    printf("List is empty (or NULL)\n");
+    PRINT_DEBUG("List is empty (or NULL)\n");
     return;
   }
 
@@ -208,7 +219,7 @@ void list_get_head(List_t *list, void **out) {
 void list_get_tail(List_t *list, void **out) {
 
   if (list == NULL || list->size == 0) {
-    printf("List is empty (or NULL)\n");
+    PRINT_DEBUG("List is empty (or NULL)\n");
     return;
   }
 
@@ -227,5 +238,5 @@ void list_foreach(List_t *list, void (*operation)(void *e)) {
     count++;
   }
 
-  printf("list_foreach: %zu number of operations performed.\n", count);
+  PRINT_DEBUG("list_foreach: %zu number of operations performed.\n", count);
 }
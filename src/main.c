@@ -1,21 +1,277 @@
+#include "include/cache.h"
+#include "include/diagnostic.h"
+#include "include/incremental.h"
 #include "include/lexer.h"
+#include "include/mem.h"
+#include "include/optimise.h"
+#include "include/parallel.h"
 #include "include/parser.h"
+#include "include/resolver.h"
+#include "include/timing.h"
 #include "include/util.h"
 #include <assert.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-int main(void) {
-  char *source = "tests/parsing-class";
-  size_t filesize = file_size_name(source);
-  char *contents = file_open_read(source);
-  Lexer *lexer = lexer_init(contents, filesize);
-  lexer_lex(lexer);
+/* Command line options shared by every file */
+typedef struct Options {
+  int opt_level;
+  bool show_mem_stats;
+  bool lazy;
+  size_t max_errors;
+  char *cache_dir; // Where parsed files are cached (NULL for no caching)
+  PassTimes *times; // Where phases are timed (NULL for no timing)
+  bool pipeline;    // Lex on a second thread while parsing
+  size_t jobs;      // Threads to parse top-level declarations on
+} Options;
+
+/* Nodes in a tree, only worth walking it for when timing. Call it once the
+   timer has stopped so the walk is not billed to the phase. */
+static size_t timed_nodes(Options *options, AST_t *program) {
+  return (options->times != NULL) ? ast_count_nodes(program) : 0;
+}
+
+/* Credits items to a phase after its timer has stopped */
+static void timed_items(Options *options, Phase phase, size_t items) {
+  if (options->times != NULL) {
+    options->times->phases[phase].items += items;
+  }
+}
+
+/* Cache files are named after the hash of the source they were made from,
+   and the flags that change what the parser makes */
+static char *cache_path(Options *options, uint64_t hash, uint32_t flags,
+                        size_t *size) {
+  *size = strlen(options->cache_dir) + 64;
+  char *path = mem_alloc(MEM_MISC, *size);
+  snprintf(path, *size, "%s/%016llx-%x.loxc", options->cache_dir,
+           (unsigned long long)hash, flags);
+  return path;
+}
+
+/* Runs the pipeline over one file, returns false if it had errors */
+static bool compile_file(char *source, Options *options) {
+  PhaseTimer timer = timer_start();
+  File_t *file = file_map_read(source);
+  if (file == NULL) {
+    return false;
+  }
+  timer_stop(options->times, PHASE_READ, timer, file->file_size, 0);
+  if (options->times != NULL) {
+    options->times->files++;
+  }
+  PRINT_TRACE("Source hash: %016llx", (unsigned long long)file->hash);
+
+  Diagnostics *diag = diagnostics_create(options->max_errors);
+
+  Lexer *lexer = lexer_init(file->file_contents, file->file_size);
+  lexer->diag = diag;
+
+  AST_t *program = NULL;
+  size_t nodes = 0; // In program, counted once and only when timing
+  uint32_t cache_flags = options->lazy ? CACHE_FLAG_LAZY : 0;
+  uint32_t cached_lazy_bodies = 0;
+  char *cached = NULL;
+  size_t cached_size = 0;
+
+  if (options->cache_dir != NULL) {
+    cached = cache_path(options, file->hash, cache_flags, &cached_size);
+    CacheView view;
+    timer = timer_start();
+    if (cache_view_open(&view, cached, file->hash, file->file_size,
+                        cache_flags)) {
+      program = cache_view_load(&view, lexer);
+      cached_lazy_bodies = view.header->lazy_bodies;
+      nodes = view.header->node_count;
+      cache_view_close(&view);
+      timer_stop(options->times, PHASE_CACHE, timer, file->file_size, nodes);
+    }
+  }
+
+  // Pipelined lexing overlaps with parsing, so it is timed as parsing
+  LexPipeline *pipeline = NULL;
+  PhaseTimer parse_timer = timer_start();
+  if (program == NULL && options->pipeline) {
+    pipeline = lex_pipeline_start(lexer);
+  }
+  if (program == NULL && pipeline == NULL) {
+    timer = timer_start();
+    lexer_lex(lexer);
+    timer_stop(options->times, PHASE_LEX, timer, file->file_size,
+               lexer->token_list->size);
+    parse_timer = timer_start();
+  }
 
   Parser *parser = init_parser(lexer);
-  parse_program(parser);
+  parser->diag = diag;
+  parser->lazy = options->lazy;
+  parser->pipeline = pipeline;
+
+  if (program != NULL) {
+    PRINT_TRACE("Loaded %zu tokens from `%s`", lexer->token_list->size,
+                cached);
+    parser->lazy_bodies = cached_lazy_bodies;
+  } else {
+    program = parse_program_parallel(parser, options->jobs);
+    if (pipeline != NULL) {
+      lex_pipeline_finish(pipeline);
+      parser->pipeline = NULL;
+    }
+    timer_stop(options->times, PHASE_PARSE, parse_timer, file->file_size, 0);
+    nodes = timed_nodes(options, program);
+    timed_items(options, PHASE_PARSE, nodes);
+    // Cache the tree as parsed, before the passes below change it
+    if (cached != NULL && diagnostics_count(diag) == 0) {
+      timer = timer_start();
+      cache_write(cached, file->hash, file->file_size, cache_flags,
+                  (uint32_t)parser->lazy_bodies, lexer->token_list, program);
+      timer_stop(options->times, PHASE_CACHE, timer, file->file_size, 0);
+    }
+  }
+
+  if (cached != NULL) {
+    mem_free(MEM_MISC, cached, cached_size);
+  }
+
+  if (options->lazy) {
+    // Without a VM to call them, a body counts as used once the script can
+    // reach it
+    timer = timer_start();
+    size_t parsed = parse_used_bodies(parser, program);
+    timer_stop(options->times, PHASE_PARSE, timer, 0, 0);
+    if (parsed > 0 && options->times != NULL) {
+      size_t before = nodes;
+      nodes = ast_count_nodes(program);
+      timed_items(options, PHASE_PARSE, nodes - before);
+    }
+    printf("Lazy parsing: %zu of %zu skipped function bodies were used\n",
+           parsed, parser->lazy_bodies);
+  }
+
+  bool ok = diagnostics_count(diag) == 0;
+  OptStats stats = {0};
+  if (ok) {
+    // Optimise first so nothing the resolver records is in a removed node
+    timer = timer_start();
+    stats = optimise_program(program, options->opt_level);
+    timer_stop(options->times, PHASE_OPTIMISE, timer, file->file_size, nodes);
+    nodes -= (options->times != NULL) ? stats.removed : 0;
+
+    timer = timer_start();
+    ok = resolve_program(program, diag);
+    timer_stop(options->times, PHASE_RESOLVE, timer, file->file_size, nodes);
+  }
+  if (!ok) {
+    diagnostics_print(diag, source, file->file_contents, file->file_size,
+                      stderr);
+    fprintf(stderr, "%s: %zu error(s)\n", source, diagnostics_count(diag));
+  } else if (options->opt_level > OPT_LEVEL_NONE) {
+    printf("Optimiser (-O%d): %zu folded, %zu node(s) removed\n",
+           options->opt_level, stats.folded, stats.removed);
+    pretty_print_ast(program, 0);
+  }
+
+  if (options->show_mem_stats) {
+    fprintf(stderr, "\nMemory before teardown:\n");
+    mem_report(stderr);
+  }
+
+  // Teardown, in reverse order since the AST points into the tokens
+  ast_destroy(program);
+  parser_destroy(parser);
+  lexer_destroy(lexer);
+  diagnostics_destroy(diag);
+  file_unmap(file);
+
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  char *default_source = "tests/parsing-class";
+  Options options = {
+      .opt_level = OPT_LEVEL_FOLD,
+      .max_errors = DIAGNOSTICS_DEFAULT_MAX,
+      .jobs = 1,
+  };
+  PassTimes times = {0};
+  bool times_json = false;
+  size_t fuzz_edits = 0;
+  unsigned fuzz_seed = 1;
+  debug_trace = true;
+  int file_count = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-O", 2) == 0) {
+      options.opt_level = atoi(argv[i] + 2);
+    } else if (strcmp(argv[i], "--mem-stats") == 0) {
+      options.show_mem_stats = true;
+    } else if (strcmp(argv[i], "--lazy") == 0) {
+      options.lazy = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      options.pipeline = true;
+    } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+      options.jobs = strtoul(argv[i] + 7, NULL, 10);
+    } else if (strcmp(argv[i], "--time-passes") == 0) {
+      options.times = &times;
+    } else if (strcmp(argv[i], "--time-passes=json") == 0) {
+      options.times = &times;
+      times_json = true;
+    } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+      options.cache_dir = argv[i] + 12;
+    } else if (strncmp(argv[i], "--max-errors=", 13) == 0) {
+      options.max_errors = strtoul(argv[i] + 13, NULL, 10);
+    } else if (strncmp(argv[i], "--fuzz-incremental=", 19) == 0) {
+      fuzz_edits = strtoul(argv[i] + 19, NULL, 10);
+    } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+      fuzz_seed = strtoul(argv[i] + 7, NULL, 10);
+    } else if (argv[i][0] == '-') {
+      print_usage();
+      exit(1);
+    } else {
+      file_count++;
+    }
+  }
+
+  if (fuzz_edits > 0) {
+    for (int i = argc - 1; i > 0; i--) {
+      if (argv[i][0] != '-') {
+        default_source = argv[i];
+        break;
+      }
+    }
+    return test_incremental(default_source, fuzz_edits, fuzz_seed) ? 0 : 1;
+  }
+
+  // Keep going past files with errors, so one run reports all of them
+  size_t failed = 0;
+  if (file_count == 0) {
+    failed += !compile_file(default_source, &options);
+  }
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-') {
+      failed += !compile_file(argv[i], &options);
+    }
+  }
+
+  if (options.times != NULL) {
+    pass_times_report(options.times, stderr, times_json);
+  }
+
+  if (options.show_mem_stats) {
+    MemStats total = mem_stats_total();
+    fprintf(stderr, "Live after teardown: %zu bytes\n", total.live);
+    if (total.live != 0) {
+      mem_report(stderr);
+      return 1;
+    }
+  }
+
+  if (failed > 0 && file_count > 1) {
+    fprintf(stderr, "%zu of %d file(s) had errors\n", failed, file_count);
+  }
 
-  /* Parser_t *parser = init_parser(lexer); */
+  return failed > 0 ? 1 : 0;
 }
@@ -0,0 +1,154 @@
+#include "include/mem.h"
+#include "include/util.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/* MemStats that can be updated from more than one thread (the lexer and
+   parser can run side by side, see pipeline.h) */
+typedef struct SharedStats {
+  _Atomic size_t live;
+  _Atomic size_t peak;
+  _Atomic size_t allocs;
+  _Atomic size_t frees;
+} SharedStats;
+
+static SharedStats stats[MEM_TAG_COUNT];
+static SharedStats total;
+
+static void stats_grow(SharedStats *s, size_t size) {
+  size_t live =
+      atomic_fetch_add_explicit(&s->live, size, memory_order_relaxed) + size;
+  size_t peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+  while (live > peak &&
+         !atomic_compare_exchange_weak_explicit(&s->peak, &peak, live,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+static void stats_shrink(SharedStats *s, size_t size) {
+  size_t live =
+      atomic_fetch_sub_explicit(&s->live, size, memory_order_relaxed);
+  assert(live >= size && "Freed more than was allocated");
+  (void)live;
+}
+
+static void stats_count(_Atomic size_t *counter) {
+  atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static MemStats stats_load(SharedStats *s) {
+  MemStats loaded = {
+      atomic_load_explicit(&s->live, memory_order_relaxed),
+      atomic_load_explicit(&s->peak, memory_order_relaxed),
+      atomic_load_explicit(&s->allocs, memory_order_relaxed),
+      atomic_load_explicit(&s->frees, memory_order_relaxed),
+  };
+  return loaded;
+}
+
+void *mem_alloc(MemTag tag, size_t size) {
+  void *ptr = calloc(1, size);
+  assert((ptr != NULL) && "Calloc failed.");
+
+  stats_count(&stats[tag].allocs);
+  stats_count(&total.allocs);
+  stats_grow(&stats[tag], size);
+  stats_grow(&total, size);
+
+  return ptr;
+}
+
+void *mem_realloc(MemTag tag, void *ptr, size_t old_size, size_t new_size) {
+  if (ptr == NULL) {
+    return mem_alloc(tag, new_size);
+  }
+
+  void *resized = realloc(ptr, new_size);
+  assert((resized != NULL) && "Realloc failed.");
+
+  if (new_size > old_size) {
+    // Keep the calloc guarantee for the new bytes
+    memset((char *)resized + old_size, 0, new_size - old_size);
+    stats_grow(&stats[tag], new_size - old_size);
+    stats_grow(&total, new_size - old_size);
+  } else {
+    stats_shrink(&stats[tag], old_size - new_size);
+    stats_shrink(&total, old_size - new_size);
+  }
+
+  return resized;
+}
+
+void mem_free(MemTag tag, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  free(ptr);
+
+  stats_count(&stats[tag].frees);
+  stats_count(&total.frees);
+  stats_shrink(&stats[tag], size);
+  stats_shrink(&total, size);
+}
+
+MemStats mem_stats(MemTag tag) { return stats_load(&stats[tag]); }
+
+MemStats mem_stats_total(void) { return stats_load(&total); }
+
+const char *mem_tag_to_str(MemTag tag) {
+  switch (tag) {
+  case MEM_SOURCE:
+    return "source";
+  case MEM_LEXER:
+    return "lexer";
+  case MEM_TOKEN:
+    return "tokens";
+  case MEM_TOKEN_STRING:
+    return "token strings";
+  case MEM_PARSER:
+    return "parser";
+  case MEM_AST:
+    return "ast nodes";
+  case MEM_ARRAY:
+    return "arrays";
+  case MEM_LIST:
+    return "list nodes";
+  case MEM_RESOLVER:
+    return "resolver";
+  case MEM_MISC:
+    return "misc";
+  case MEM_TAG_COUNT:
+    break;
+  }
+
+  return "unknown";
+}
+
+void mem_report(FILE *out) {
+  fprintf(out, "%-14s %12s %12s %10s %10s\n", "subsystem", "live", "peak",
+          "allocs", "frees");
+
+  for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+    MemStats s = stats_load(&stats[tag]);
+    if (s.allocs == 0) {
+      continue;
+    }
+    fprintf(out, "%-14s %12zu %12zu %10zu %10zu\n", mem_tag_to_str(tag),
+            s.live, s.peak, s.allocs, s.frees);
+  }
+
+  MemStats t = stats_load(&total);
+  fprintf(out, "%-14s %12zu %12zu %10zu %10zu\n", "total", t.live, t.peak,
+          t.allocs, t.frees);
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    // Linux reports this in KiB
+    fprintf(out, "peak RSS: %ld KiB\n", usage.ru_maxrss);
+  }
+}
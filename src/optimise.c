@@ -0,0 +1,441 @@
+#include "include/optimise.h"
+#include "include/mem.h"
+#include "include/util.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Optimiser state */
+typedef struct Optimiser {
+  int level;
+  OptStats stats;
+} Optimiser;
+
+AST_t *optimise_stmt(Optimiser *opt, AST_t *node);
+
+/*****************************************************************************/
+/*                                 Constants                                 */
+/*****************************************************************************/
+
+static bool is_literal_keyword(AST_t *node, TokenType type) {
+  return node->type == AST_PRIMARY && node->primary.value->type == type;
+}
+
+/* Returns true if the node is a literal value */
+static bool is_constant(AST_t *node) {
+  return node->type == AST_INT_LIT || node->type == AST_STRING_LIT ||
+         is_literal_keyword(node, TOKEN_TRUE) ||
+         is_literal_keyword(node, TOKEN_FALSE) ||
+         is_literal_keyword(node, TOKEN_NIL);
+}
+
+/* Returns true if the node always produces a boolean */
+static bool is_boolean(AST_t *node) {
+  if (is_literal_keyword(node, TOKEN_TRUE) ||
+      is_literal_keyword(node, TOKEN_FALSE)) {
+    return true;
+  }
+
+  if (node->type == AST_UNARY) {
+    return node->unary.op->type == TOKEN_BANG;
+  }
+
+  if (node->type == AST_BINARY) {
+    switch (node->binary.op->type) {
+    case TOKEN_BANG_EQUAL:
+    case TOKEN_EQUAL_EQUAL:
+    case TOKEN_GREATER:
+    case TOKEN_GREATER_EQUAL:
+    case TOKEN_LESS:
+    case TOKEN_LESS_EQUAL:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  return false;
+}
+
+/* Lox truthiness: only `nil` and `false` are falsey */
+static bool is_truthy(AST_t *node) {
+  return !is_literal_keyword(node, TOKEN_NIL) &&
+         !is_literal_keyword(node, TOKEN_FALSE);
+}
+
+static double number_value(AST_t *node) {
+  return strtod(node->int_literal.num->str, NULL);
+}
+
+/* Allocates a token for a folded value, positioned at the operator. The
+   node it ends up in owns it. */
+static Token *token_create(TokenType type, Token *at, char *str, size_t len) {
+  Token *token = mem_alloc(MEM_TOKEN, sizeof(Token));
+  token->type = type;
+  token->pos = at->pos;
+  token->str = str;
+  token->len = len;
+  return token;
+}
+
+static AST_t *make_number(double value, Token *at) {
+  char buffer[32];
+  int len = snprintf(buffer, sizeof(buffer), "%.17g", value);
+  char *str = mem_alloc(MEM_TOKEN_STRING, len + 1);
+  memcpy(str, buffer, len);
+
+  AST_t *ast = ast_create(AST_INT_LIT);
+  ast->int_literal.num = token_create(TOKEN_NUMBER, at, str, len);
+  ast->owned_token = ast->int_literal.num;
+  return ast;
+}
+
+static AST_t *make_bool(bool value, Token *at) {
+  char *word = value ? "true" : "false";
+  size_t len = strlen(word);
+  char *str = mem_alloc(MEM_TOKEN_STRING, len + 1);
+  memcpy(str, word, len);
+
+  AST_t *ast = ast_create(AST_PRIMARY);
+  ast->primary.slot = -1;
+  ast->primary.value =
+      token_create(value ? TOKEN_TRUE : TOKEN_FALSE, at, str, len);
+  ast->owned_token = ast->primary.value;
+  return ast;
+}
+
+static AST_t *make_string(Token *left, Token *right, Token *at) {
+  size_t len = left->len + right->len;
+  char *str = mem_alloc(MEM_TOKEN_STRING, len + 1);
+  memcpy(str, left->str, left->len);
+  memcpy(str + left->len, right->str, right->len);
+
+  AST_t *ast = ast_create(AST_STRING_LIT);
+  ast->str_literal.str = token_create(TOKEN_STRING, at, str, len);
+  ast->owned_token = ast->str_literal.str;
+  return ast;
+}
+
+/* Lox equality between two literals */
+static bool constants_equal(AST_t *a, AST_t *b) {
+  if (a->type == AST_INT_LIT && b->type == AST_INT_LIT) {
+    return number_value(a) == number_value(b);
+  }
+
+  if (a->type == AST_STRING_LIT && b->type == AST_STRING_LIT) {
+    Token *x = a->str_literal.str;
+    Token *y = b->str_literal.str;
+    return x->len == y->len && memcmp(x->str, y->str, x->len) == 0;
+  }
+
+  if (a->type == AST_PRIMARY && b->type == AST_PRIMARY) {
+    return a->primary.value->type == b->primary.value->type;
+  }
+
+  return false;
+}
+
+/*****************************************************************************/
+/*                                Expressions                                */
+/*****************************************************************************/
+
+/* Swaps node for its replacement, counting and freeing what disappeared */
+static AST_t *replace(Optimiser *opt, AST_t *node, AST_t *replacement) {
+  opt->stats.removed += ast_count_nodes(node) - ast_count_nodes(replacement);
+  ast_destroy_except(node, replacement);
+  return replacement;
+}
+
+/* Removes a node entirely */
+static void discard(Optimiser *opt, AST_t *node) {
+  opt->stats.removed += ast_count_nodes(node);
+  ast_destroy(node);
+}
+
+static AST_t *fold(Optimiser *opt, AST_t *node, AST_t *constant) {
+  opt->stats.folded++;
+  return replace(opt, node, constant);
+}
+
+AST_t *optimise_expr(Optimiser *opt, AST_t *node);
+
+static AST_t *optimise_unary(Optimiser *opt, AST_t *node) {
+  AST_t *right = optimise_expr(opt, node->unary.right);
+  node->unary.right = right;
+  Token *op = node->unary.op;
+
+  if (op->type == TOKEN_MINUS && right->type == AST_INT_LIT) {
+    return fold(opt, node, make_number(-number_value(right), op));
+  }
+
+  if (op->type != TOKEN_BANG) {
+    return node;
+  }
+
+  if (is_constant(right)) {
+    return fold(opt, node, make_bool(!is_truthy(right), op));
+  }
+
+  // `!!x` is `x` when x is already a boolean, and `!!!x` is always `!x`
+  if (right->type == AST_UNARY && right->unary.op->type == TOKEN_BANG) {
+    AST_t *inner = right->unary.right;
+    if (is_boolean(inner)) {
+      return replace(opt, node, inner);
+    }
+    if (inner->type == AST_UNARY && inner->unary.op->type == TOKEN_BANG) {
+      return replace(opt, node, inner);
+    }
+  }
+
+  return node;
+}
+
+static AST_t *optimise_binary(Optimiser *opt, AST_t *node) {
+  AST_t *left = optimise_expr(opt, node->binary.left);
+  AST_t *right = optimise_expr(opt, node->binary.right);
+  node->binary.left = left;
+  node->binary.right = right;
+  Token *op = node->binary.op;
+
+  if (!is_constant(left) || !is_constant(right)) {
+    return node;
+  }
+
+  if (op->type == TOKEN_EQUAL_EQUAL) {
+    return fold(opt, node, make_bool(constants_equal(left, right), op));
+  }
+  if (op->type == TOKEN_BANG_EQUAL) {
+    return fold(opt, node, make_bool(!constants_equal(left, right), op));
+  }
+
+  if (left->type == AST_STRING_LIT && right->type == AST_STRING_LIT &&
+      op->type == TOKEN_PLUS) {
+    return fold(opt, node,
+                make_string(left->str_literal.str, right->str_literal.str, op));
+  }
+
+  // Anything else is only foldable between two numbers
+  if (left->type != AST_INT_LIT || right->type != AST_INT_LIT) {
+    return node;
+  }
+
+  double a = number_value(left);
+  double b = number_value(right);
+  double result;
+
+  switch (op->type) {
+  case TOKEN_PLUS:
+    result = a + b;
+    break;
+  case TOKEN_MINUS:
+    result = a - b;
+    break;
+  case TOKEN_STAR:
+    result = a * b;
+    break;
+  case TOKEN_SLASH:
+    result = a / b;
+    break;
+  case TOKEN_GREATER:
+    return fold(opt, node, make_bool(a > b, op));
+  case TOKEN_GREATER_EQUAL:
+    return fold(opt, node, make_bool(a >= b, op));
+  case TOKEN_LESS:
+    return fold(opt, node, make_bool(a < b, op));
+  case TOKEN_LESS_EQUAL:
+    return fold(opt, node, make_bool(a <= b, op));
+  default:
+    return node;
+  }
+
+  // inf and nan have no literal form, leave them to the runtime
+  if (!isfinite(result)) {
+    return node;
+  }
+
+  return fold(opt, node, make_number(result, op));
+}
+
+AST_t *optimise_expr(Optimiser *opt, AST_t *node) {
+  if (node == NULL || opt->level < OPT_LEVEL_FOLD) {
+    return node;
+  }
+
+  switch (node->type) {
+  case AST_UNARY:
+    return optimise_unary(opt, node);
+  case AST_BINARY:
+    return optimise_binary(opt, node);
+  case AST_CALL:
+    node->call.callee = optimise_expr(opt, node->call.callee);
+    if (node->call.args != NULL) {
+      for (size_t i = 0; i < node->call.args->size; i++) {
+        node->call.args->items[i] =
+            optimise_expr(opt, node->call.args->items[i]);
+      }
+    }
+    return node;
+  case AST_GET:
+    node->get.object = optimise_expr(opt, node->get.object);
+    return node;
+  default:
+    return node;
+  }
+}
+
+/* Conditions only care about truthiness, so `!!x` is always `x` there */
+static AST_t *optimise_condition(Optimiser *opt, AST_t *node) {
+  node = optimise_expr(opt, node);
+
+  while (opt->level >= OPT_LEVEL_FOLD && node->type == AST_UNARY &&
+         node->unary.op->type == TOKEN_BANG &&
+         node->unary.right->type == AST_UNARY &&
+         node->unary.right->unary.op->type == TOKEN_BANG) {
+    node = replace(opt, node, node->unary.right->unary.right);
+  }
+
+  return node;
+}
+
+/*****************************************************************************/
+/*                                 Statements                                */
+/*****************************************************************************/
+
+/* Optimises a list of statements in place, dropping removed ones and
+   anything after a `return` */
+static void optimise_list(Optimiser *opt, array_T *list) {
+  if (list == NULL) {
+    return;
+  }
+
+  size_t kept = 0;
+  size_t i = 0;
+
+  for (; i < list->size; i++) {
+    AST_t *stmt = optimise_stmt(opt, list->items[i]);
+    if (stmt == NULL) {
+      continue;
+    }
+
+    list->items[kept++] = stmt;
+
+    if (opt->level >= OPT_LEVEL_DEAD && stmt->type == AST_RETURN_STMT) {
+      i++;
+      break;
+    }
+  }
+
+  // Unreachable statements after a return
+  for (; i < list->size; i++) {
+    discard(opt, list->items[i]);
+  }
+
+  list->size = kept;
+}
+
+/* Optimises the branch of an if statement, which has to stay a statement */
+static AST_t *optimise_branch(Optimiser *opt, AST_t *node) {
+  if (node == NULL) {
+    return NULL;
+  }
+
+  AST_t *branch = optimise_stmt(opt, node);
+  if (branch != NULL) {
+    return branch;
+  }
+
+  // Keep an empty block in its place
+  opt->stats.removed--;
+  return ast_create(AST_BLOCK);
+}
+
+static AST_t *optimise_if(Optimiser *opt, AST_t *node) {
+  node->if_stmt.condition = optimise_condition(opt, node->if_stmt.condition);
+  node->if_stmt.then_branch = optimise_branch(opt, node->if_stmt.then_branch);
+  node->if_stmt.else_branch = optimise_branch(opt, node->if_stmt.else_branch);
+
+  AST_t *condition = node->if_stmt.condition;
+  if (opt->level < OPT_LEVEL_DEAD || !is_constant(condition)) {
+    return node;
+  }
+
+  AST_t *taken = is_truthy(condition) ? node->if_stmt.then_branch
+                                      : node->if_stmt.else_branch;
+  taken = replace(opt, node, taken);
+
+  // An empty branch can go as well
+  if (taken != NULL && taken->type == AST_BLOCK && taken->children == NULL) {
+    discard(opt, taken);
+    return NULL;
+  }
+
+  return taken;
+}
+
+/* Returns the optimised statement, or NULL if it was removed entirely */
+AST_t *optimise_stmt(Optimiser *opt, AST_t *node) {
+  if (node == NULL) {
+    return NULL;
+  }
+
+  switch (node->type) {
+  case AST_CLASS_DECL:
+    optimise_list(opt, node->children);
+    return node;
+  case AST_FUNC_DECL:
+    optimise_list(opt, node->func_decl.children);
+    return node;
+  case AST_PRINT_STMT:
+    if (node->print_stmt.print_targets != NULL) {
+      array_T *targets = node->print_stmt.print_targets;
+      for (size_t i = 0; i < targets->size; i++) {
+        targets->items[i] = optimise_expr(opt, targets->items[i]);
+      }
+    }
+    return node;
+  case AST_RETURN_STMT:
+    node->return_stmt.value = optimise_expr(opt, node->return_stmt.value);
+    return node;
+  case AST_VAR:
+    node->var_decl.value = optimise_expr(opt, node->var_decl.value);
+    return node;
+  case AST_IF_STMT:
+    return optimise_if(opt, node);
+  case AST_BLOCK:
+    optimise_list(opt, node->children);
+    if (opt->level >= OPT_LEVEL_DEAD &&
+        (node->children == NULL || node->children->size == 0)) {
+      discard(opt, node);
+      return NULL;
+    }
+    return node;
+  case AST_STATEMENT:
+    node->expr_stmt.expr = optimise_expr(opt, node->expr_stmt.expr);
+    // Empty statements and bare constants have no effect
+    if (opt->level >= OPT_LEVEL_DEAD &&
+        (node->expr_stmt.expr == NULL || is_constant(node->expr_stmt.expr))) {
+      discard(opt, node);
+      return NULL;
+    }
+    return node;
+  default:
+    return node;
+  }
+}
+
+OptStats optimise_program(AST_t *program, int level) {
+  Optimiser opt = {.level = level, .stats = {0, 0}};
+
+  if (level <= OPT_LEVEL_NONE) {
+    return opt.stats;
+  }
+
+  optimise_list(&opt, program->children);
+
+  PRINT_TRACE("Optimised at level %d: %zu folded, %zu node(s) removed", level,
+              opt.stats.folded, opt.stats.removed);
+
+  return opt.stats;
+}
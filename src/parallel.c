@@ -0,0 +1,186 @@
+#include "include/parallel.h"
+#include "include/diagnostic.h"
+#include "include/mem.h"
+#include "include/util.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct ParallelParse {
+  Lexer *lexer;
+  bool lazy;
+  size_t *bounds; // Slice i is the tokens [bounds[i], bounds[i + 1])
+  size_t bounds_capacity;
+  size_t slice_count;
+  array_T **results; // Declarations parsed from each slice
+
+  _Atomic size_t next; // Next slice nobody has taken yet
+  _Atomic bool failed; // A slice did not parse the way it would in sequence
+  _Atomic size_t lazy_bodies;
+} ParallelParse;
+
+/* Finds where top-level declarations start. Returns the number of slices;
+   bounds gets one more entry than that, the index of the EOF token. */
+static size_t find_slices(array_T *tokens, size_t min_slice,
+                          size_t **bounds_out, size_t *capacity_out) {
+  size_t capacity = 16;
+  size_t *bounds = mem_alloc(MEM_MISC, capacity * sizeof(size_t));
+  size_t count = 1; // The first slice starts at 0
+  long depth = 0;
+  size_t eof = tokens->size - 1;
+
+  for (size_t i = 1; i < eof; i++) {
+    Token *previous = tokens->items[i - 1];
+    switch (previous->type) {
+    case TOKEN_LEFT_BRACE:
+    case TOKEN_LEFTPAREN:
+      depth++;
+      break;
+    case TOKEN_RIGHT_BRACE:
+    case TOKEN_RIGHT_PAREN:
+      depth--;
+      break;
+    default:
+      break;
+    }
+
+    Token *token = tokens->items[i];
+    if (depth != 0 ||
+        (token->type != TOKEN_CLASS && token->type != TOKEN_FUNC) ||
+        (previous->type != TOKEN_RIGHT_BRACE &&
+         previous->type != TOKEN_SEMICOLON) ||
+        i - bounds[count - 1] < min_slice) {
+      continue;
+    }
+
+    if (count + 1 == capacity) {
+      bounds = mem_realloc(MEM_MISC, bounds, capacity * sizeof(size_t),
+                           capacity * 2 * sizeof(size_t));
+      capacity *= 2;
+    }
+    bounds[count++] = i;
+  }
+
+  bounds[count] = eof;
+  *bounds_out = bounds;
+  *capacity_out = capacity;
+  return count;
+}
+
+static void *parse_worker(void *arg) {
+  ParallelParse *work = arg;
+
+  // Every worker has its own parser, the tokens are only read
+  Diagnostics *diag = diagnostics_create(1);
+  Parser *parser = init_parser(work->lexer);
+  parser->diag = diag;
+  parser->lazy = work->lazy;
+
+  while (!atomic_load_explicit(&work->failed, memory_order_relaxed)) {
+    size_t slice =
+        atomic_fetch_add_explicit(&work->next, 1, memory_order_relaxed);
+    if (slice >= work->slice_count) {
+      break;
+    }
+
+    size_t end = work->bounds[slice + 1];
+    array_T *decls = array_create(sizeof(AST_t *));
+    work->results[slice] = decls;
+
+    parser_seek(parser, work->bounds[slice]);
+    while (parser->index < end && parser->token->type != TOKEN_EOF) {
+      size_t start = parser->index;
+      AST_t *decl = parse_declaration(parser);
+      if (decl != NULL) {
+        decl->token_start = start;
+        decl->token_end = parser->index;
+      }
+      array_push(decls, decl);
+    }
+
+    if (parser->index != end || diagnostics_count(diag) > 0) {
+      atomic_store_explicit(&work->failed, true, memory_order_relaxed);
+    }
+  }
+
+  atomic_fetch_add_explicit(&work->lazy_bodies, parser->lazy_bodies,
+                            memory_order_relaxed);
+  parser_destroy(parser);
+  diagnostics_destroy(diag);
+  return NULL;
+}
+
+AST_t *parse_program_parallel(Parser *parser, size_t jobs) {
+  // Tokens still being lexed cannot be sliced up front
+  if (jobs < 2 || parser->pipeline != NULL || parser->index != 0) {
+    return parse_program(parser);
+  }
+
+  ParallelParse work = {0};
+  work.lexer = parser->lexer;
+  work.lazy = parser->lazy;
+  work.slice_count =
+      find_slices(parser->lexer->token_list, PARALLEL_MIN_SLICE, &work.bounds,
+                  &work.bounds_capacity);
+  work.results = mem_alloc(MEM_MISC, work.slice_count * sizeof(array_T *));
+
+  if (jobs > work.slice_count) {
+    jobs = work.slice_count;
+  }
+  PRINT_TRACE_IF(parser->trace, "Parsing %zu slice(s) on %zu thread(s)",
+                 work.slice_count, jobs);
+
+  // This thread is one of the workers
+  size_t started = 0;
+  pthread_t *threads = mem_alloc(MEM_MISC, jobs * sizeof(pthread_t));
+  for (size_t i = 0; i + 1 < jobs; i++) {
+    if (pthread_create(&threads[started], NULL, parse_worker, &work) == 0) {
+      started++;
+    }
+  }
+  parse_worker(&work);
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  mem_free(MEM_MISC, threads, jobs * sizeof(pthread_t));
+
+  bool failed = atomic_load(&work.failed);
+  AST_t *ast = NULL;
+
+  if (!failed) {
+    ast = ast_create(AST_COMPOUND);
+    ast->type = AST_PROGRAM;
+  }
+
+  // Stitch the slices back together in source order
+  for (size_t i = 0; i < work.slice_count; i++) {
+    array_T *decls = work.results[i];
+    if (decls == NULL) {
+      continue;
+    }
+    for (size_t j = 0; j < decls->size; j++) {
+      if (failed) {
+        ast_destroy(decls->items[j]);
+      } else {
+        array_push(ast->children, decls->items[j]);
+      }
+    }
+    array_destroy(decls);
+  }
+
+  mem_free(MEM_MISC, work.results, work.slice_count * sizeof(array_T *));
+  mem_free(MEM_MISC, work.bounds, work.bounds_capacity * sizeof(size_t));
+
+  if (failed) {
+    PRINT_TRACE_IF(parser->trace, "%s",
+                   "A slice did not parse cleanly, parsing in sequence");
+    return parse_program(parser);
+  }
+
+  parser->lazy_bodies += atomic_load(&work.lazy_bodies);
+  parser_seek(parser, parser->lexer->token_list->size - 1);
+
+  if (parser->trace) {
+    pretty_print_ast(ast, 0);
+  }
+  return ast;
+}
@@ -1,19 +1,20 @@
 #include "include/parser.h"
 #include "include/lexer.h"
+#include "include/mem.h"
 #include "include/token.h"
+#include <assert.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
-AST_t *parse_declaration(Parser *parser);
-
-static size_t index = 0;
-
 Parser *init_parser(Lexer *lex) {
-  Parser *parser = calloc(1, sizeof(Parser));
+  Parser *parser = mem_alloc(MEM_PARSER, sizeof(Parser));
   parser->lexer = lex;
+  parser->index = 0;
+  parser->trace = lex->trace;
 
   if (parser->lexer->token_list->items) {
-    parser->token = (Token *)parser->lexer->token_list->items[index];
+    parser->token = (Token *)parser->lexer->token_list->items[parser->index];
   } else {
     exit(1);
   }
@@ -21,6 +22,24 @@ Parser *init_parser(Lexer *lex) {
   return parser;
 }
 
+/* True if there is a token at index, waiting for the lexer thread to get that
+   far if it is still running */
+static bool parser_has_token(Parser *parser, size_t index) {
+  if (parser->pipeline != NULL && index >= parser->lexer->token_list->size) {
+    return lex_pipeline_fill(parser->pipeline, index);
+  }
+  return index < parser->lexer->token_list->size;
+}
+
+// Moves the parser to the token at index
+void parser_seek(Parser *parser, size_t index) {
+  bool found = parser_has_token(parser, index);
+  assert(found && "Seeking past the end");
+  (void)found;
+  parser->index = index;
+  parser->token = (Token *)parser->lexer->token_list->items[index];
+}
+
 void parser_destroy(Parser *parser) {
   // Free lexer->source
   // Free lexer->token->str
@@ -28,33 +47,226 @@ void parser_destroy(Parser *parser) {
   // Then free the list struct
   // Free lexer->tokenlist
   // Then finally free the parser
-  free(parser);
+  mem_free(MEM_PARSER, parser, sizeof(Parser));
+}
+
+/* Reports an error at token. Only the first error is reported until the
+   parser has synchronised, the rest are likely caused by it. */
+static void parser_error(Parser *parser, Token *token, const char *format,
+                         ...) {
+  if (parser->panic) {
+    return;
+  }
+  parser->panic = true;
+
+  va_list args;
+  va_start(args, format);
+  diagnostics_vreport(parser->diag, SYNTAX, token->offset,
+                      token_lexeme_end(token), token->pos, format, args);
+  va_end(args);
 }
 
 // Returns the token that has been eaten and advances to next token
 Token *eat(Parser *parser, TokenType type) {
   if (parser->token->type != type) {
-    PRINT_ERROR("Error! Token type expected: `%s`, but received: `%s`",
-                tokentype_to_string(type),
-                tokentype_to_string(parser->token->type));
-    exit(1);
+    parser_error(parser, parser->token, "Expected `%s` but found `%s`",
+                 tokentype_to_string(type),
+                 tokentype_to_string(parser->token->type));
+    // Leave the token for synchronising to deal with
+    return parser->token;
   }
 
   Token *curr = parser->token;
-  if (index < parser->lexer->token_list->size) {
-    index++;
-    Token *next = (Token *)parser->lexer->token_list->items[index];
+  if (parser_has_token(parser, parser->index + 1)) {
+    parser->index++;
+    Token *next = (Token *)parser->lexer->token_list->items[parser->index];
     parser->token = next;
   } else {
-    printf("Finished parsing!\n");
+    PRINT_DEBUG_IF(parser->trace, "Finished parsing!\n");
     exit(1);
   }
 
-  printf("Eaten token with type `%s`\n", tokentype_to_string(type));
+  PRINT_DEBUG_IF(parser->trace, "Eaten token with type `%s`\n",
+                 tokentype_to_string(type));
 
   return curr;
 }
 
+/*****************************************************************************/
+/*                                Expressions                                */
+/*****************************************************************************/
+
+AST_t *parse_expression(Parser *parser);
+
+AST_t *ast_binary(AST_t *left, Token *op, AST_t *right) {
+  AST_t *ast = ast_create(AST_BINARY);
+  ast->binary.left = left;
+  ast->binary.op = op;
+  ast->binary.right = right;
+  return ast;
+}
+
+// NOTE: primary = NUMBER | STRING | "true" | "false" | "nil" | "this"
+//               | IDENTIFIER | "(" expression ")"
+AST_t *parse_primary(Parser *parser) {
+  AST_t *ast;
+
+  switch (parser->token->type) {
+  case TOKEN_NUMBER: {
+    ast = ast_create(AST_INT_LIT);
+    ast->int_literal.num = eat(parser, TOKEN_NUMBER);
+    return ast;
+  }
+  case TOKEN_STRING: {
+    ast = ast_create(AST_STRING_LIT);
+    ast->str_literal.str = eat(parser, TOKEN_STRING);
+    return ast;
+  }
+  case TOKEN_TRUE:
+  case TOKEN_FALSE:
+  case TOKEN_NIL:
+  case TOKEN_THIS:
+  case TOKEN_IDENTIFIER: {
+    ast = ast_create(AST_PRIMARY);
+    ast->primary.slot = -1;
+    ast->primary.value = eat(parser, parser->token->type);
+    return ast;
+  }
+  case TOKEN_LEFTPAREN: {
+    // Groupings do not need a node of their own
+    eat(parser, TOKEN_LEFTPAREN);
+    ast = parse_expression(parser);
+    eat(parser, TOKEN_RIGHT_PAREN);
+    return ast;
+  }
+  default:
+    parser_error(parser, parser->token, "Expected an expression but found `%s`",
+                 tokentype_to_string(parser->token->type));
+    if (parser->token->type != TOKEN_EOF) {
+      parser_seek(parser, parser->index + 1);
+    }
+    return NULL;
+  }
+}
+
+// NOTE: arguments = expression ( "," expression )*
+array_T *parse_call_args(Parser *parser) {
+  if (parser->token->type == TOKEN_RIGHT_PAREN) {
+    return NULL;
+  }
+
+  array_T *args = array_create(sizeof(AST_t *));
+  array_push(args, parse_expression(parser));
+
+  while (parser->token->type == TOKEN_COMMA) {
+    eat(parser, TOKEN_COMMA);
+    array_push(args, parse_expression(parser));
+  }
+
+  return args;
+}
+
+// NOTE: call = primary ( "(" arguments? ")" | "." IDENTIFIER )*
+AST_t *parse_call(Parser *parser) {
+  AST_t *ast = parse_primary(parser);
+
+  while (true) {
+    if (parser->token->type == TOKEN_LEFTPAREN) {
+      eat(parser, TOKEN_LEFTPAREN);
+      AST_t *call = ast_create(AST_CALL);
+      call->call.callee = ast;
+      call->call.args = parse_call_args(parser);
+      call->call.paren = eat(parser, TOKEN_RIGHT_PAREN);
+      ast = call;
+    } else if (parser->token->type == TOKEN_DOT) {
+      eat(parser, TOKEN_DOT);
+      AST_t *get = ast_create(AST_GET);
+      get->get.object = ast;
+      get->get.name = eat(parser, TOKEN_IDENTIFIER);
+      ast = get;
+    } else {
+      break;
+    }
+  }
+
+  return ast;
+}
+
+// NOTE: unary = ( "!" | "-" ) unary | call
+AST_t *parse_unary(Parser *parser) {
+  TokenType type = parser->token->type;
+  if (type == TOKEN_BANG || type == TOKEN_MINUS) {
+    AST_t *ast = ast_create(AST_UNARY);
+    ast->unary.op = eat(parser, type);
+    ast->unary.right = parse_unary(parser);
+    return ast;
+  }
+
+  return parse_call(parser);
+}
+
+// NOTE: factor = unary ( ( "/" | "*" ) unary )*
+AST_t *parse_factor(Parser *parser) {
+  AST_t *ast = parse_unary(parser);
+
+  while (parser->token->type == TOKEN_SLASH ||
+         parser->token->type == TOKEN_STAR) {
+    Token *op = eat(parser, parser->token->type);
+    ast = ast_binary(ast, op, parse_unary(parser));
+  }
+
+  return ast;
+}
+
+// NOTE: term = factor ( ( "-" | "+" ) factor )*
+AST_t *parse_term(Parser *parser) {
+  AST_t *ast = parse_factor(parser);
+
+  while (parser->token->type == TOKEN_MINUS ||
+         parser->token->type == TOKEN_PLUS) {
+    Token *op = eat(parser, parser->token->type);
+    ast = ast_binary(ast, op, parse_factor(parser));
+  }
+
+  return ast;
+}
+
+// NOTE: comparison = term ( ( ">" | ">=" | "<" | "<=" ) term )*
+AST_t *parse_comparison(Parser *parser) {
+  AST_t *ast = parse_term(parser);
+
+  while (parser->token->type == TOKEN_GREATER ||
+         parser->token->type == TOKEN_GREATER_EQUAL ||
+         parser->token->type == TOKEN_LESS ||
+         parser->token->type == TOKEN_LESS_EQUAL) {
+    Token *op = eat(parser, parser->token->type);
+    ast = ast_binary(ast, op, parse_term(parser));
+  }
+
+  return ast;
+}
+
+// NOTE: equality = comparison ( ( "!=" | "==" ) comparison )*
+AST_t *parse_equality(Parser *parser) {
+  AST_t *ast = parse_comparison(parser);
+
+  while (parser->token->type == TOKEN_BANG_EQUAL ||
+         parser->token->type == TOKEN_EQUAL_EQUAL) {
+    Token *op = eat(parser, parser->token->type);
+    ast = ast_binary(ast, op, parse_comparison(parser));
+  }
+
+  return ast;
+}
+
+AST_t *parse_expression(Parser *parser) { return parse_equality(parser); }
+
+/*****************************************************************************/
+/*                                 Statements                                */
+/*****************************************************************************/
+
+array_T *parse_block(Parser *parser);
+
 AST_t *parse_statement(Parser *parser) {
   AST_t *ast = ast_create(AST_STATEMENT);
   TokenType type = parser->token->type;
@@ -65,16 +277,37 @@ AST_t *parse_statement(Parser *parser) {
     ast->type = AST_PRINT_STMT;
     eat(parser, TOKEN_PRINT);
 
-    /*   // TODO Finish implementing this */
-    /* ast->print_stmt.print_targets = array_create(sizeof(AST_t *)); */
-    /* while (parser->token->type != TOKEN_SEMICOLON) { */
+    ast->print_stmt.print_targets = array_create(sizeof(AST_t *));
+    array_push(ast->print_stmt.print_targets, parse_expression(parser));
+  } else if (type == TOKEN_RETURN) {
 
-    /*   array_push(ast->print_stmt.print_targets, parse_expression(parser)); */
-    /* } */
+    ast->type = AST_RETURN_STMT;
+    ast->return_stmt.keyword = eat(parser, TOKEN_RETURN);
+    if (parser->token->type != TOKEN_SEMICOLON) {
+      ast->return_stmt.value = parse_expression(parser);
+    }
+  } else if (type == TOKEN_IF) {
 
-    // FIXME 2023-10-08 Remove this and replace with the code above after
-    // implementing expression parsing
-    eat(parser, TOKEN_STRING);
+    // NOTE: ifStmt = "if" "(" expression ")" statement ( "else" statement )?
+    ast->type = AST_IF_STMT;
+    eat(parser, TOKEN_IF);
+    eat(parser, TOKEN_LEFTPAREN);
+    ast->if_stmt.condition = parse_expression(parser);
+    eat(parser, TOKEN_RIGHT_PAREN);
+    ast->if_stmt.then_branch = parse_statement(parser);
+    if (parser->token->type == TOKEN_ELSE) {
+      eat(parser, TOKEN_ELSE);
+      ast->if_stmt.else_branch = parse_statement(parser);
+    }
+    // The branches have eaten their own semicolons
+    return ast;
+  } else if (type == TOKEN_LEFT_BRACE) {
+
+    ast->type = AST_BLOCK;
+    ast->children = parse_block(parser);
+    return ast;
+  } else if (type != TOKEN_SEMICOLON) {
+    ast->expr_stmt.expr = parse_expression(parser);
   }
   eat(parser, TOKEN_SEMICOLON);
   return ast;
@@ -82,7 +315,7 @@ AST_t *parse_statement(Parser *parser) {
 
 AST_t *parse_identifier(Parser *parser) {
   if (parser->token->type != TOKEN_IDENTIFIER) {
-    printf("No identifier found. \n");
+    PRINT_DEBUG_IF(parser->trace, "No identifier found. \n");
     return NULL;
   }
   Token *token = eat(parser, TOKEN_IDENTIFIER);
@@ -100,16 +333,59 @@ array_T *parse_block(Parser *parser) {
     return NULL;
   }
 
+  parser->depth++;
   array_T *blockbody = array_create(sizeof(AST_t *));
-  while (parser->token->type != TOKEN_RIGHT_BRACE) {
+  while (parser->token->type != TOKEN_RIGHT_BRACE &&
+         parser->token->type != TOKEN_EOF) {
     array_push(blockbody, parse_declaration(parser));
   }
+  parser->depth--;
 
   eat(parser, TOKEN_RIGHT_BRACE);
 
   return blockbody;
 }
 
+/* Steps over a function body from its `{` by matching brackets, leaving the
+   parser after its `}`. Only unbalanced brackets are caught here, anything
+   else is reported once the body is parsed. */
+static void skip_body(Parser *parser) {
+  Token *open = parser->token;
+  size_t braces = 0;
+  size_t parens = 0;
+
+  do {
+    switch (parser->token->type) {
+    case TOKEN_LEFT_BRACE:
+      braces++;
+      break;
+    case TOKEN_RIGHT_BRACE:
+      if (parens > 0) {
+        parser_error(parser, parser->token, "%s", "Unclosed `(` before `}`");
+        parens = 0;
+      }
+      braces--;
+      break;
+    case TOKEN_LEFTPAREN:
+      parens++;
+      break;
+    case TOKEN_RIGHT_PAREN:
+      if (parens == 0) {
+        parser_error(parser, parser->token, "%s", "Unexpected `)`");
+        break;
+      }
+      parens--;
+      break;
+    case TOKEN_EOF:
+      parser_error(parser, open, "%s", "Function body is never closed");
+      return;
+    default:
+      break;
+    }
+    parser_seek(parser, parser->index + 1);
+  } while (braces > 0);
+}
+
 array_T *parse_args(Parser *parser) {
   /* printf("Parsing arguments.\n"); */
   eat(parser, TOKEN_LEFTPAREN);
@@ -122,10 +398,18 @@ array_T *parse_args(Parser *parser) {
   array_T *args = array_create(sizeof(Token *));
 
   while (parser->token->type != TOKEN_RIGHT_PAREN) {
+    if (parser->token->type != TOKEN_IDENTIFIER) {
+      eat(parser, TOKEN_IDENTIFIER); // Reports the error
+      break;
+    }
     array_push(args, eat(parser, TOKEN_IDENTIFIER));
     if (parser->token->type == TOKEN_RIGHT_PAREN) {
       break;
     }
+    if (parser->token->type != TOKEN_COMMA) {
+      eat(parser, TOKEN_COMMA); // Reports the error
+      break;
+    }
     eat(parser, TOKEN_COMMA);
   }
 
@@ -137,7 +421,7 @@ array_T *parse_args(Parser *parser) {
 AST_t *parse_function(Parser *parser) {
   AST_t *ast = ast_create(AST_COMPOUND);
   ast->type = AST_FUNC_DECL;
-  printf("[FUNC PTR] `%p`\n", (void *)ast);
+  PRINT_DEBUG_IF(parser->trace, "[FUNC PTR] `%p`\n", (void *)ast);
   eat(parser, TOKEN_FUNC);
 
   ast->func_decl.name = eat(parser, TOKEN_IDENTIFIER);
@@ -145,6 +429,19 @@ AST_t *parse_function(Parser *parser) {
   // parse arguments
   ast->func_decl.args = parse_args(parser);
 
+  // Top-level functions and methods can only capture globals, so their
+  // bodies can wait until something uses them. After an error the body is
+  // parsed straight away, which recovers better than matching brackets. A
+  // body missing its `{` is too, so its error matches the eager parser's.
+  if (parser->lazy && parser->depth == 0 && !parser->panic &&
+      parser->token->type == TOKEN_LEFT_BRACE) {
+    ast->func_decl.is_lazy = true;
+    ast->func_decl.body_start = parser->index;
+    skip_body(parser);
+    parser->lazy_bodies++;
+    return ast;
+  }
+
   ast->func_decl.children = parse_block(parser);
   if (ast->func_decl.children != NULL) {
     ast->func_decl.has_body = true;
@@ -155,7 +452,7 @@ AST_t *parse_function(Parser *parser) {
 
 AST_t *parse_class(Parser *parser) {
   AST_t *ast = ast_create(AST_COMPOUND);
-  printf("[CLASS PTR] `%p`\n", (void *)ast);
+  PRINT_DEBUG_IF(parser->trace, "[CLASS PTR] `%p`\n", (void *)ast);
   ast->type = AST_CLASS_DECL;
 
   /* printf("Class being parsed: `%p`\n", (void *)ast); */
@@ -167,8 +464,11 @@ AST_t *parse_class(Parser *parser) {
   /* printf("Class name is: `%s`\n", ast->name); */
   eat(parser, TOKEN_LEFT_BRACE);
 
-  while (parser->token->type != TOKEN_RIGHT_BRACE) {
+  while (parser->token->type == TOKEN_FUNC) {
     array_push(ast->children, parse_function(parser));
+    if (parser->panic) {
+      break;
+    }
   }
 
   if (ast->children != NULL) {
@@ -180,9 +480,74 @@ AST_t *parse_class(Parser *parser) {
   return ast;
 }
 
+// NOTE: varDeclaration = "var" IDENTIFIER ( "=" expression )? ";"
+AST_t *parse_var(Parser *parser) {
+  AST_t *ast = ast_create(AST_VAR);
+  eat(parser, TOKEN_VAR);
+  ast->var_decl.name = eat(parser, TOKEN_IDENTIFIER);
+  ast->var_decl.slot = -1;
+
+  if (parser->token->type == TOKEN_EQUAL) {
+    eat(parser, TOKEN_EQUAL);
+    ast->var_decl.has_val = true;
+    ast->var_decl.value = parse_expression(parser);
+  }
+
+  eat(parser, TOKEN_SEMICOLON);
+  return ast;
+}
+
+/* Skips tokens until one that likely starts a declaration, so one error does
+   not cascade into many */
+static void synchronise(Parser *parser) {
+  parser->panic = false;
+
+  while (parser->token->type != TOKEN_EOF) {
+    if (parser->index > 0) {
+      Token *previous = parser->lexer->token_list->items[parser->index - 1];
+      if (previous->type == TOKEN_SEMICOLON) {
+        return;
+      }
+    }
+
+    switch (parser->token->type) {
+    case TOKEN_CLASS:
+    case TOKEN_FUNC:
+    case TOKEN_VAR:
+    case TOKEN_FOR:
+    case TOKEN_IF:
+    case TOKEN_WHILE:
+    case TOKEN_PRINT:
+    case TOKEN_RETURN:
+      return;
+    default:
+      break;
+    }
+
+    parser_seek(parser, parser->index + 1);
+  }
+}
+
+static AST_t *parse_declaration_inner(Parser *parser);
+
 // NOTE: Declaration = classDeclaration | funDeclaration
 //                   | varDeclaration | statement
 AST_t *parse_declaration(Parser *parser) {
+  size_t start = parser->index;
+  AST_t *ast = parse_declaration_inner(parser);
+
+  if (parser->panic) {
+    synchronise(parser);
+    // Always make progress, or the same error comes round again
+    if (parser->index == start && parser->token->type != TOKEN_EOF) {
+      parser_seek(parser, parser->index + 1);
+    }
+  }
+
+  return ast;
+}
+
+static AST_t *parse_declaration_inner(Parser *parser) {
   /* AST_t *ast = ast_create(AST_DECLARATION); */
 
   // Parse class
@@ -197,8 +562,7 @@ AST_t *parse_declaration(Parser *parser) {
   }
 
   case TOKEN_VAR: {
-    // parse var
-    return NULL;
+    return parse_var(parser);
   }
 
   default: {
@@ -214,12 +578,167 @@ AST_t *parse_program(Parser *parser) {
   AST_t *ast = ast_create(AST_COMPOUND);
   ast->type = AST_PROGRAM;
 
-  PRINT_TRACE("Root: `%p`", (void *)ast);
+  PRINT_TRACE_IF(parser->trace, "Root: `%p`", (void *)ast);
 
   while (parser->token->type != TOKEN_EOF) {
-    array_push(ast->children, parse_declaration(parser));
+    size_t start = parser->index;
+    AST_t *decl = parse_declaration(parser);
+    if (decl != NULL) {
+      decl->token_start = start;
+      decl->token_end = parser->index;
+    }
+    array_push(ast->children, decl);
   }
 
-  pretty_print_ast(ast, 0);
+  if (parser->trace) {
+    pretty_print_ast(ast, 0);
+  }
   return ast;
 }
+
+/*****************************************************************************/
+/*                                Lazy bodies                                */
+/*****************************************************************************/
+
+bool parse_lazy_body(Parser *parser, AST_t *function) {
+  if (!function->func_decl.is_lazy) {
+    return false;
+  }
+
+  size_t index = parser->index;
+  int depth = parser->depth;
+
+  parser->depth = 0;
+  parser_seek(parser, function->func_decl.body_start);
+  function->func_decl.children = parse_block(parser);
+  function->func_decl.has_body = function->func_decl.children != NULL;
+  function->func_decl.is_lazy = false;
+
+  parser->depth = depth;
+  parser->panic = false;
+  parser_seek(parser, index);
+
+  return true;
+}
+
+typedef struct LazyUse {
+  Parser *parser;
+  AST_t *program; // Where used names are looked up
+  size_t parsed;
+} LazyUse;
+
+static void use_node(LazyUse *use, AST_t *node);
+
+static void use_list(LazyUse *use, array_T *nodes) {
+  if (nodes == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < nodes->size; i++) {
+    use_node(use, nodes->items[i]);
+  }
+}
+
+static void use_function(LazyUse *use, AST_t *function) {
+  if (parse_lazy_body(use->parser, function)) {
+    use->parsed++;
+    use_list(use, function->func_decl.children);
+  }
+}
+
+static bool name_is(Token *name, const char *str, size_t len) {
+  return name->len == len && memcmp(name->str, str, len) == 0;
+}
+
+/* Parses whatever a use of name could call: a top-level function, a class'
+   initializer or, for property names, every method with that name */
+static void use_name(LazyUse *use, Token *name, bool is_property) {
+  array_T *decls = use->program->children;
+
+  for (size_t i = 0; i < decls->size; i++) {
+    AST_t *decl = decls->items[i];
+    if (decl == NULL) {
+      continue;
+    }
+
+    if (decl->type == AST_FUNC_DECL && !is_property &&
+        name_is(decl->func_decl.name, name->str, name->len)) {
+      use_function(use, decl);
+    } else if (decl->type == AST_CLASS_DECL && decl->children != NULL) {
+      bool is_class = !is_property && name_is(decl->class_decl.name,
+                                              name->str, name->len);
+      if (!is_class && !is_property) {
+        continue;
+      }
+
+      for (size_t j = 0; j < decl->children->size; j++) {
+        AST_t *method = decl->children->items[j];
+        if ((is_class && name_is(method->func_decl.name, "init", 4)) ||
+            (is_property &&
+             name_is(method->func_decl.name, name->str, name->len))) {
+          use_function(use, method);
+        }
+      }
+    }
+  }
+}
+
+static void use_node(LazyUse *use, AST_t *node) {
+  if (node == NULL) {
+    return;
+  }
+
+  switch (node->type) {
+  case AST_FUNC_DECL:
+    // Bodies that are still lazy are parsed once something uses them
+    use_list(use, node->func_decl.children);
+    return;
+  case AST_VAR:
+    use_node(use, node->var_decl.value);
+    break;
+  case AST_PRINT_STMT:
+    use_list(use, node->print_stmt.print_targets);
+    break;
+  case AST_STATEMENT:
+    use_node(use, node->expr_stmt.expr);
+    break;
+  case AST_IF_STMT:
+    use_node(use, node->if_stmt.condition);
+    use_node(use, node->if_stmt.then_branch);
+    use_node(use, node->if_stmt.else_branch);
+    break;
+  case AST_RETURN_STMT:
+    use_node(use, node->return_stmt.value);
+    break;
+  case AST_BINARY:
+    use_node(use, node->binary.left);
+    use_node(use, node->binary.right);
+    break;
+  case AST_UNARY:
+    use_node(use, node->unary.right);
+    break;
+  case AST_CALL:
+    use_node(use, node->call.callee);
+    use_list(use, node->call.args);
+    break;
+  case AST_GET:
+    use_node(use, node->get.object);
+    use_name(use, node->get.name, true);
+    break;
+  case AST_PRIMARY:
+    if (node->primary.value->type == TOKEN_IDENTIFIER) {
+      use_name(use, node->primary.value, false);
+    }
+    break;
+  default:
+    break;
+  }
+
+  // Programs, blocks and classes keep their contents here
+  use_list(use, node->children);
+}
+
+size_t parse_used_bodies(Parser *parser, AST_t *program) {
+  LazyUse use = {parser, program, 0};
+  use_node(&use, program);
+  return use.parsed;
+}
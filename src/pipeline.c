@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "include/pipeline.h"
+#include "include/mem.h"
+#include "include/util.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdint.h>
+
+/* Returns the next free batch, waiting for the parser to free one if the ring
+   is full */
+static TokenBatch *ring_reserve(TokenRing *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  while (head - ring->tail_seen == TOKEN_RING_SIZE) {
+    ring->tail_seen = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - ring->tail_seen == TOKEN_RING_SIZE) {
+      sched_yield();
+    }
+  }
+
+  return &ring->batches[head % TOKEN_RING_SIZE];
+}
+
+/* Hands the batch from ring_reserve to the parser */
+static void ring_publish(TokenRing *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* Returns the oldest published batch, waiting for one if the ring is empty,
+   or NULL once the ring is closed and empty */
+static TokenBatch *ring_peek(TokenRing *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  while (ring->head_seen == tail) {
+    // Load closed first: if it is set, head is final by the time it is read
+    bool closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+    ring->head_seen = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (ring->head_seen != tail) {
+      break;
+    }
+    if (closed) {
+      return NULL;
+    }
+    sched_yield();
+  }
+
+  return &ring->batches[tail % TOKEN_RING_SIZE];
+}
+
+/* Gives the batch from ring_peek back to the lexer thread */
+static void ring_release(TokenRing *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static void *lex_thread(void *arg) {
+  LexPipeline *pipeline = arg;
+  Lexer *lexer = pipeline->producer;
+  TokenRing *ring = pipeline->ring;
+  bool finished = false;
+
+  while (!finished) {
+    TokenBatch *batch = ring_reserve(ring);
+    batch->count = 0;
+
+    while (batch->count < TOKEN_BATCH_SIZE) {
+      Token *token = lexer_next_token(lexer);
+      if (token == NULL) {
+        finished = true;
+        break;
+      }
+      assert(lexer->token_list->size == 1 && "One token per scan");
+      batch->tokens[batch->count++] = token;
+      lexer->token_list->size = 0; // The batch owns it now
+    }
+
+    if (batch->count > 0) {
+      ring_publish(ring);
+    }
+  }
+
+  atomic_store_explicit(&ring->closed, true, memory_order_release);
+  return NULL;
+}
+
+LexPipeline *lex_pipeline_start(Lexer *lexer) {
+  LexPipeline *pipeline = mem_alloc(MEM_MISC, sizeof(LexPipeline));
+  pipeline->lexer = lexer;
+  pipeline->ring = mem_alloc(MEM_MISC, sizeof(TokenRing));
+
+  // Only the new thread touches the producer, so it needs its own token list
+  // and somewhere of its own to report to
+  pipeline->producer = mem_alloc(MEM_LEXER, sizeof(Lexer));
+  *pipeline->producer = *lexer;
+  pipeline->producer->token_list = array_create(sizeof(Token *));
+  if (lexer->diag != NULL) {
+    pipeline->diag = diagnostics_create(lexer->diag->max);
+  }
+  pipeline->producer->diag = pipeline->diag;
+
+  if (pthread_create(&pipeline->thread, NULL, lex_thread, pipeline) != 0) {
+    PRINT_ERROR("%s", "Could not start the lexer thread");
+    lexer_destroy(pipeline->producer);
+    diagnostics_destroy(pipeline->diag);
+    mem_free(MEM_MISC, pipeline->ring, sizeof(TokenRing));
+    mem_free(MEM_MISC, pipeline, sizeof(LexPipeline));
+    return NULL;
+  }
+
+  // There is always at least the EOF token
+  lex_pipeline_fill(pipeline, 0);
+  return pipeline;
+}
+
+bool lex_pipeline_fill(LexPipeline *pipeline, size_t index) {
+  array_T *tokens = pipeline->lexer->token_list;
+
+  while (tokens->size <= index) {
+    TokenBatch *batch = ring_peek(pipeline->ring);
+    if (batch == NULL) {
+      return false;
+    }
+
+    for (size_t i = 0; i < batch->count; i++) {
+      array_push(tokens, batch->tokens[i]);
+    }
+    ring_release(pipeline->ring);
+  }
+
+  return true;
+}
+
+void lex_pipeline_finish(LexPipeline *pipeline) {
+  Lexer *lexer = pipeline->lexer;
+  Lexer *producer = pipeline->producer;
+
+  // The lexer thread may be waiting for room in the ring
+  lex_pipeline_fill(pipeline, SIZE_MAX);
+  pthread_join(pipeline->thread, NULL);
+
+  lexer->cursor = producer->cursor;
+  lexer->line_position = producer->line_position;
+  lexer->line_start = producer->line_start;
+
+  if (pipeline->diag != NULL) {
+    diagnostics_merge(lexer->diag, pipeline->diag);
+    diagnostics_destroy(pipeline->diag);
+  }
+
+  lexer_destroy(producer); // Every token it made is in lexer's list
+  mem_free(MEM_MISC, pipeline->ring, sizeof(TokenRing));
+  mem_free(MEM_MISC, pipeline, sizeof(LexPipeline));
+}
@@ -0,0 +1,425 @@
+#include "include/resolver.h"
+#include "include/mem.h"
+#include "include/util.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Name of slot 0 in plain functions, never matches a real identifier */
+static Token empty_token = {.type = TOKEN_IDENTIFIER, .str = "", .len = 0};
+/* Name of slot 0 in methods */
+static Token this_token = {.type = TOKEN_THIS, .str = "this", .len = 4};
+/* Name of class initialisers */
+static Token init_token = {.type = TOKEN_IDENTIFIER, .str = "init", .len = 4};
+
+void resolve_node(Resolver *resolver, AST_t *node);
+
+/* Reports an error at the name it is about */
+static void resolver_error(Resolver *resolver, Token *name, const char *format,
+                           ...) {
+  resolver->error_count++;
+
+  va_list args;
+  va_start(args, format);
+  diagnostics_vreport(resolver->diag, MISC, name->offset,
+                      token_lexeme_end(name), name->pos, format, args);
+  va_end(args);
+}
+
+/* Compares two identifier tokens by their text */
+static bool names_equal(Token *a, Token *b) {
+  return a->len == b->len && memcmp(a->str, b->str, a->len) == 0;
+}
+
+/* Writes the captured flag of a local back to the node that declared it */
+static void local_sync_decl(Local *local, AST_t *decl) {
+  if (decl == NULL) {
+    return;
+  }
+
+  switch (decl->type) {
+  case AST_CLASS_DECL:
+    decl->class_decl.captured = local->captured;
+    break;
+  case AST_FUNC_DECL:
+    decl->func_decl.captured = local->captured;
+    break;
+  case AST_VAR:
+    decl->var_decl.captured = local->captured;
+    break;
+  default:
+    break;
+  }
+}
+
+/*****************************************************************************/
+/*                                   Scopes                                  */
+/*****************************************************************************/
+
+static void function_scope_begin(Resolver *resolver, FunctionScope *fs,
+                                 AST_t *function, bool is_method) {
+  fs->enclosing = resolver->current;
+  fs->function = function;
+  fs->local_count = 0;
+  fs->upvalue_count = 0;
+  fs->scope_depth = 0;
+  fs->is_initializer = false;
+  resolver->current = fs;
+
+  // Slot 0 holds the callee itself, or the receiver for methods
+  Local *local = mem_alloc(MEM_RESOLVER, sizeof(Local));
+  local->name = is_method ? &this_token : &empty_token;
+  local->depth = 0;
+  local->slot = 0;
+  fs->locals[fs->local_count++] = local;
+
+  if (function != NULL) {
+    function->func_decl.locals = array_create(sizeof(Local *));
+    function->func_decl.upvalues = array_create(sizeof(Upvalue *));
+    function->func_decl.local_count = 1;
+    array_push(function->func_decl.locals, local);
+  }
+}
+
+static void function_scope_end(Resolver *resolver) {
+  FunctionScope *fs = resolver->current;
+
+  if (fs->function != NULL) {
+    for (size_t i = 0; i < fs->upvalue_count; i++) {
+      array_push(fs->function->func_decl.upvalues, fs->upvalues[i]);
+    }
+  } else {
+    // Nothing records the script's locals, so they are freed here
+    mem_free(MEM_RESOLVER, fs->locals[0], sizeof(Local));
+  }
+
+  resolver->current = fs->enclosing;
+}
+
+static void scope_begin(Resolver *resolver) {
+  resolver->current->scope_depth++;
+}
+
+/* Pops every local declared in the scope being closed */
+static void scope_end(Resolver *resolver) {
+  FunctionScope *fs = resolver->current;
+  fs->scope_depth--;
+
+  while (fs->local_count > 0 &&
+         fs->locals[fs->local_count - 1]->depth > fs->scope_depth) {
+    Local *local = fs->locals[fs->local_count - 1];
+    local_sync_decl(local, local->decl);
+    fs->local_count--;
+    if (fs->function == NULL) {
+      mem_free(MEM_RESOLVER, local, sizeof(Local));
+    }
+  }
+}
+
+/* Declares a name in the current scope. Returns the new local, or NULL if the
+   name is a global. */
+static Local *declare(Resolver *resolver, Token *name, AST_t *decl) {
+  FunctionScope *fs = resolver->current;
+
+  if (fs->scope_depth == 0) {
+    PRINT_TRACE("Global `%.*s`", (int)name->len, name->str);
+    return NULL;
+  }
+
+  for (size_t i = fs->local_count; i > 0; i--) {
+    Local *local = fs->locals[i - 1];
+    if (local->depth != -1 && local->depth < fs->scope_depth) {
+      break;
+    }
+    if (names_equal(name, local->name)) {
+      resolver_error(resolver, name, "Already a variable named `%.*s` in this "
+                     "scope", (int)name->len, name->str);
+    }
+  }
+
+  if (fs->local_count == RESOLVER_MAX_LOCALS) {
+    resolver_error(resolver, name, "%s",
+                   "Too many local variables in function");
+    return NULL;
+  }
+
+  Local *local = mem_alloc(MEM_RESOLVER, sizeof(Local));
+  local->name = name;
+  local->decl = decl;
+  local->depth = -1;
+  local->slot = (int)fs->local_count;
+  fs->locals[fs->local_count++] = local;
+
+  if (fs->function != NULL) {
+    array_push(fs->function->func_decl.locals, local);
+    if (fs->local_count > fs->function->func_decl.local_count) {
+      fs->function->func_decl.local_count = fs->local_count;
+    }
+  }
+
+  PRINT_TRACE("Local `%.*s` -> slot %d", (int)name->len, name->str,
+              local->slot);
+  return local;
+}
+
+/* Marks a declared local as usable */
+static void define(Resolver *resolver, Local *local) {
+  if (local == NULL) {
+    return;
+  }
+  local->depth = resolver->current->scope_depth;
+}
+
+/*****************************************************************************/
+/*                              Name resolution                              */
+/*****************************************************************************/
+
+static int resolve_local(Resolver *resolver, FunctionScope *fs, Token *name) {
+  for (size_t i = fs->local_count; i > 0; i--) {
+    Local *local = fs->locals[i - 1];
+    if (names_equal(name, local->name)) {
+      if (local->depth == -1) {
+        resolver_error(resolver, name,
+                       "Can't read `%.*s` in its own initializer",
+                       (int)name->len, name->str);
+      }
+      return local->slot;
+    }
+  }
+
+  return -1;
+}
+
+static int add_upvalue(Resolver *resolver, FunctionScope *fs, Token *name,
+                       int index, bool is_local) {
+  for (size_t i = 0; i < fs->upvalue_count; i++) {
+    Upvalue *upvalue = fs->upvalues[i];
+    if (upvalue->index == index && upvalue->is_local == is_local) {
+      return (int)i;
+    }
+  }
+
+  if (fs->upvalue_count == RESOLVER_MAX_UPVALUES) {
+    resolver_error(resolver, name, "%s",
+                   "Too many closure variables in function");
+    return 0;
+  }
+
+  Upvalue *upvalue = mem_alloc(MEM_RESOLVER, sizeof(Upvalue));
+  upvalue->index = index;
+  upvalue->is_local = is_local;
+  fs->upvalues[fs->upvalue_count] = upvalue;
+
+  return (int)fs->upvalue_count++;
+}
+
+static int resolve_upvalue(Resolver *resolver, FunctionScope *fs,
+                           Token *name) {
+  if (fs->enclosing == NULL) {
+    return -1;
+  }
+
+  int slot = resolve_local(resolver, fs->enclosing, name);
+  if (slot != -1) {
+    fs->enclosing->locals[slot]->captured = true;
+    return add_upvalue(resolver, fs, name, slot, true);
+  }
+
+  int upvalue = resolve_upvalue(resolver, fs->enclosing, name);
+  if (upvalue != -1) {
+    return add_upvalue(resolver, fs, name, upvalue, false);
+  }
+
+  return -1;
+}
+
+int resolve_name(Resolver *resolver, Token *name, bool *is_upvalue) {
+  *is_upvalue = false;
+
+  int slot = resolve_local(resolver, resolver->current, name);
+  if (slot != -1) {
+    return slot;
+  }
+
+  int upvalue = resolve_upvalue(resolver, resolver->current, name);
+  if (upvalue != -1) {
+    *is_upvalue = true;
+    return upvalue;
+  }
+
+  return -1;
+}
+
+/*****************************************************************************/
+/*                                Declarations                               */
+/*****************************************************************************/
+
+/* Resolves the parameters and body of a function or method */
+static void resolve_function_body(Resolver *resolver, AST_t *function,
+                                  bool is_method) {
+  FunctionScope fs;
+  function_scope_begin(resolver, &fs, function, is_method);
+  fs.is_initializer = is_method && names_equal(function->func_decl.name,
+                                                &init_token);
+  scope_begin(resolver);
+
+  if (function->func_decl.args != NULL) {
+    for (size_t i = 0; i < function->func_decl.args->size; i++) {
+      Token *name = function->func_decl.args->items[i];
+      Local *param = declare(resolver, name, NULL);
+      define(resolver, param);
+    }
+  }
+
+  if (function->func_decl.has_body) {
+    for (size_t i = 0; i < function->func_decl.children->size; i++) {
+      resolve_node(resolver, function->func_decl.children->items[i]);
+    }
+  }
+
+  scope_end(resolver);
+  function_scope_end(resolver);
+}
+
+static void resolve_function(Resolver *resolver, AST_t *function) {
+  Local *local = declare(resolver, function->func_decl.name, function);
+  function->func_decl.slot = (local != NULL) ? local->slot : -1;
+  // Defined straight away so the function can refer to itself
+  define(resolver, local);
+
+  resolve_function_body(resolver, function, false);
+}
+
+static void resolve_class(Resolver *resolver, AST_t *class) {
+  Local *local = declare(resolver, class->class_decl.name, class);
+  class->class_decl.slot = (local != NULL) ? local->slot : -1;
+  define(resolver, local);
+
+  if (class->children != NULL) {
+    for (size_t i = 0; i < class->children->size; i++) {
+      AST_t *method = class->children->items[i];
+      method->func_decl.slot = -1; // Methods live on the class, not the stack
+      resolve_function_body(resolver, method, true);
+    }
+  }
+}
+
+static void resolve_var(Resolver *resolver, AST_t *var) {
+  Local *local = declare(resolver, var->var_decl.name, var);
+  var->var_decl.slot = (local != NULL) ? local->slot : -1;
+
+  if (var->var_decl.has_val) {
+    resolve_node(resolver, var->var_decl.value);
+  }
+
+  define(resolver, local);
+}
+
+/* A call returned straight from a function can reuse the caller's frame,
+   unless the function is the script or an initialiser (which must return
+   `this`) */
+static void resolve_return(Resolver *resolver, AST_t *node) {
+  AST_t *value = node->return_stmt.value;
+  resolve_node(resolver, value);
+
+  FunctionScope *fs = resolver->current;
+  if (value == NULL || value->type != AST_CALL) {
+    return;
+  }
+
+  if (fs->function != NULL && !fs->is_initializer) {
+    value->call.is_tail = true;
+  }
+}
+
+void resolve_node(Resolver *resolver, AST_t *node) {
+  if (node == NULL) {
+    return;
+  }
+
+  switch (node->type) {
+  case AST_CLASS_DECL:
+    resolve_class(resolver, node);
+    return;
+  case AST_FUNC_DECL:
+    resolve_function(resolver, node);
+    return;
+  case AST_VAR:
+    resolve_var(resolver, node);
+    return;
+  case AST_PRINT_STMT:
+    if (node->print_stmt.print_targets != NULL) {
+      for (size_t i = 0; i < node->print_stmt.print_targets->size; i++) {
+        resolve_node(resolver, node->print_stmt.print_targets->items[i]);
+      }
+    }
+    return;
+  case AST_BLOCK:
+    scope_begin(resolver);
+    if (node->children != NULL) {
+      for (size_t i = 0; i < node->children->size; i++) {
+        resolve_node(resolver, node->children->items[i]);
+      }
+    }
+    scope_end(resolver);
+    return;
+  case AST_STATEMENT:
+    resolve_node(resolver, node->expr_stmt.expr);
+    return;
+  case AST_IF_STMT:
+    resolve_node(resolver, node->if_stmt.condition);
+    resolve_node(resolver, node->if_stmt.then_branch);
+    resolve_node(resolver, node->if_stmt.else_branch);
+    return;
+  case AST_RETURN_STMT:
+    resolve_return(resolver, node);
+    return;
+  case AST_CALL:
+    resolve_node(resolver, node->call.callee);
+    if (node->call.args != NULL) {
+      for (size_t i = 0; i < node->call.args->size; i++) {
+        resolve_node(resolver, node->call.args->items[i]);
+      }
+    }
+    return;
+  case AST_GET:
+    resolve_node(resolver, node->get.object);
+    return;
+  case AST_BINARY:
+    resolve_node(resolver, node->binary.left);
+    resolve_node(resolver, node->binary.right);
+    return;
+  case AST_UNARY:
+    resolve_node(resolver, node->unary.right);
+    return;
+  case AST_PRIMARY:
+    if (node->primary.value->type == TOKEN_IDENTIFIER ||
+        node->primary.value->type == TOKEN_THIS) {
+      bool *is_upvalue = &node->primary.is_upvalue;
+      node->primary.slot = resolve_name(resolver, node->primary.value,
+                                        is_upvalue);
+    }
+    return;
+  default:
+    break;
+  }
+
+  if (node->children != NULL) {
+    for (size_t i = 0; i < node->children->size; i++) {
+      resolve_node(resolver, node->children->items[i]);
+    }
+  }
+}
+
+bool resolve_program(AST_t *program, Diagnostics *diag) {
+  Resolver resolver = {0};
+  resolver.diag = diag;
+  FunctionScope script;
+
+  function_scope_begin(&resolver, &script, NULL, false);
+  resolve_node(&resolver, program);
+  function_scope_end(&resolver);
+
+  return resolver.error_count == 0;
+}
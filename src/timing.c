@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "include/timing.h"
+#include <time.h>
+
+static uint64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  if (clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+PhaseTimer timer_start(void) {
+  PhaseTimer timer = {clock_ns(CLOCK_MONOTONIC),
+                      clock_ns(CLOCK_PROCESS_CPUTIME_ID)};
+  return timer;
+}
+
+void timer_stop(PassTimes *times, Phase phase, PhaseTimer start, size_t bytes,
+                size_t items) {
+  if (times == NULL) {
+    return;
+  }
+
+  PhaseStats *stats = &times->phases[phase];
+  stats->wall_ns += clock_ns(CLOCK_MONOTONIC) - start.wall;
+  stats->cpu_ns += clock_ns(CLOCK_PROCESS_CPUTIME_ID) - start.cpu;
+  stats->runs++;
+  stats->bytes += bytes;
+  stats->items += items;
+}
+
+const char *phase_to_str(Phase phase) {
+  switch (phase) {
+  case PHASE_READ:
+    return "read";
+  case PHASE_CACHE:
+    return "cache";
+  case PHASE_LEX:
+    return "lex";
+  case PHASE_PARSE:
+    return "parse";
+  case PHASE_RESOLVE:
+    return "resolve";
+  case PHASE_OPTIMISE:
+    return "optimise";
+  default:
+    return "unknown";
+  }
+}
+
+/* Amount per second, or 0 for phases too quick for the clock */
+static double per_second(size_t amount, uint64_t ns) {
+  return (ns > 0) ? amount * 1e9 / ns : 0.0;
+}
+
+void pass_times_report(PassTimes *times, FILE *out, bool json) {
+  PhaseStats total = {0};
+
+  if (json) {
+    fprintf(out, "{\"files\": %zu, \"phases\": [", times->files);
+  } else {
+    fprintf(out, "Pass timing for %zu file(s):\n", times->files);
+    fprintf(out, "%-10s %12s %12s %10s %10s %14s\n", "phase", "wall ms",
+            "cpu ms", "MB/s", "items", "items/s");
+  }
+
+  bool first = true;
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    PhaseStats s = times->phases[phase];
+    if (s.runs == 0) {
+      continue;
+    }
+
+    total.wall_ns += s.wall_ns;
+    total.cpu_ns += s.cpu_ns;
+    total.runs += s.runs;
+
+    if (json) {
+      fprintf(out,
+              "%s\n  {\"phase\": \"%s\", \"runs\": %zu, \"wall_ns\": %llu, "
+              "\"cpu_ns\": %llu, \"bytes\": %zu, \"items\": %zu, "
+              "\"bytes_per_sec\": %.0f, \"items_per_sec\": %.0f}",
+              first ? "" : ",", phase_to_str(phase), s.runs,
+              (unsigned long long)s.wall_ns, (unsigned long long)s.cpu_ns,
+              s.bytes, s.items, per_second(s.bytes, s.wall_ns),
+              per_second(s.items, s.wall_ns));
+    } else {
+      fprintf(out, "%-10s %12.3f %12.3f %10.2f %10zu %14.0f\n",
+              phase_to_str(phase), s.wall_ns / 1e6, s.cpu_ns / 1e6,
+              per_second(s.bytes, s.wall_ns) / 1e6, s.items,
+              per_second(s.items, s.wall_ns));
+    }
+    first = false;
+  }
+
+  if (json) {
+    fprintf(out, "\n], \"total_wall_ns\": %llu, \"total_cpu_ns\": %llu}\n",
+            (unsigned long long)total.wall_ns,
+            (unsigned long long)total.cpu_ns);
+  } else {
+    fprintf(out, "%-10s %12.3f %12.3f\n", "total", total.wall_ns / 1e6,
+            total.cpu_ns / 1e6);
+  }
+}
@@ -1,7 +1,31 @@
 #include "include/token.h"
+#include "include/mem.h"
 #include <stdlib.h>
 #include <string.h>
 
+/* Returns the offset just past the token's lexeme in the source */
+size_t token_lexeme_end(Token *token) {
+  // String tokens do not keep their quotes
+  if (token->type == TOKEN_STRING) {
+    return token->offset + token->len + 2;
+  }
+  return token->offset + token->len;
+}
+
+/* Returns true if both tokens have the same type, text and position */
+bool token_equal(Token *a, Token *b) {
+  return a->type == b->type && a->len == b->len && a->offset == b->offset &&
+         a->pos.line == b->pos.line && a->pos.x == b->pos.x &&
+         memcmp(a->str, b->str, a->len) == 0;
+}
+
+/* Frees a token and its string */
+void token_destroy(void *tkn) {
+  Token *token = (Token *)tkn;
+  mem_free(MEM_TOKEN_STRING, (void *)token->str, token->len + 1);
+  mem_free(MEM_TOKEN, token, sizeof(Token));
+}
+
 char *tokentype_to_string(TokenType type) {
   switch (type) {
 
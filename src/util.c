@@ -1,8 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "include/util.h"
 #include "include/ast.h"
+#include "include/mem.h"
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool debug_trace = false;
 
 /* Returns local time. Useful for runtime debugging. */
 const char *get_local_time(void) {
@@ -16,17 +26,17 @@ const char *get_local_time(void) {
 }
 
 /* NOTE Revisit this function when the name of the project is decided */
-void print_usage(void) { printf("Usage: %s  <file-to-compile>\n", "<nicer> "); }
+void print_usage(void) {
+  printf("Usage: %s [-O<level>] [--mem-stats] [--lazy] [--pipeline] "
+         "[--jobs=<n>] [--max-errors=<n>] [--cache-dir=<dir>] "
+         "[--time-passes[=json]] "
+         "[--fuzz-incremental=<edits> [--seed=<n>]] "
+         "<file-to-compile>...\n",
+         "<nicer> ");
+}
 
 /* Functions for file handling ***********************************************/
 
-/* NOTE Unused struct */
-typedef struct File_t {
-  size_t file_size;
-  char *file_contents;
-
-} File_t;
-
 /* Opens file and returns a pointer. */
 FILE *file_open(char *filename) {
 
@@ -42,16 +52,16 @@ FILE *file_open(char *filename) {
   return fp;
 }
 
-// Returns string of file contents
+// Returns string of file contents, or NULL if it could not be read. An empty
+// file gives an empty string.
 char *file_open_read(char *filename) {
 
   // Opening file
   FILE *filePtr = fopen(filename, "rb");
 
   if (filePtr == NULL) { // If error
-    PRINT_ERROR("FILE %s does not exist!", filename);
-    print_usage();
-    exit(1);
+    PRINT_ERROR("Could not open `%s`: %s", filename, strerror(errno));
+    return NULL;
   }
 
   PRINT_TRACE("File '%s' has been opened", filename);
@@ -65,15 +75,20 @@ char *file_open_read(char *filename) {
     return NULL;
   }
 
-  size_t filesize = ftell(filePtr);
-  assert(filesize > 0 && "File is empty!");
+  long tell = ftell(filePtr);
+  if (tell < 0) {
+    PRINT_ERROR("Could not get the size of `%s`", filename);
+    fclose(filePtr);
+    return NULL;
+  }
+  size_t filesize = tell;
   rewind(filePtr); // Moving cursor back to beginning of file
   PRINT_TRACE("File size is: %zu", filesize);
 
   // Retrieving contents of file
   char *contents =
-      calloc((filesize + 1), sizeof(char)); // String to store the bytes read
-  contents[filesize] = '\0';                // Will terminate the char
+      mem_alloc(MEM_SOURCE, filesize + 1); // String to store the bytes read
+  contents[filesize] = '\0';               // Will terminate the char
   size_t readCount = 0; // Keeps track of the number of bytes read
   size_t loopCount = 0; // Keeps track of iterations
 
@@ -92,7 +107,8 @@ char *file_open_read(char *filename) {
     }
 
     // Reading bytes
-    size_t currBytesRead = fread(contents, 1, filesize - readCount, filePtr);
+    size_t currBytesRead =
+        fread(contents + readCount, 1, filesize - readCount, filePtr);
     readCount += currBytesRead;
     PRINT_TRACE("Loop: %zu, readCount: %zu", loopCount, readCount);
     loopCount++;
@@ -102,6 +118,7 @@ char *file_open_read(char *filename) {
   if (readCount != filesize) {
     PRINT_ERROR("%s", "Not all of the file was read!");
     fclose(filePtr);
+    mem_free(MEM_SOURCE, contents, filesize + 1);
     return NULL;
   }
 
@@ -145,3 +162,119 @@ size_t file_size_ptr(FILE *fileptr) {
 
   return size;
 }
+
+/* Reads all filesize bytes of an open file into a '\0' terminated buffer.
+   Returns NULL, having printed why, if it ends early or can't be read. */
+static char *fd_read(int fd, char *filename, size_t filesize) {
+  char *contents = mem_alloc(MEM_SOURCE, filesize + 1);
+  contents[filesize] = '\0';
+
+  size_t readCount = 0;
+  while (readCount < filesize) {
+    ssize_t currBytesRead =
+        read(fd, contents + readCount, filesize - readCount);
+    if (currBytesRead == -1 && errno == EINTR) {
+      continue;
+    }
+    if (currBytesRead <= 0) {
+      PRINT_ERROR("Not all of `%s` was read", filename);
+      mem_free(MEM_SOURCE, contents, filesize + 1);
+      return NULL;
+    }
+    readCount += currBytesRead;
+  }
+
+  return contents;
+}
+
+/* Maps a file into memory with a single open, falling back to reading it when
+   the mapping would not leave room for the terminating '\0' the lexer
+   expects. Returns NULL, having printed why, if the file can't be read; an
+   empty file is read as an empty source. */
+File_t *file_map_read(char *filename) {
+
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    PRINT_ERROR("Could not open `%s`: %s", filename, strerror(errno));
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    PRINT_ERROR("Could not stat `%s`", filename);
+    close(fd);
+    return NULL;
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    PRINT_ERROR("`%s` is not a regular file", filename);
+    close(fd);
+    return NULL;
+  }
+
+  size_t filesize = st.st_size;
+
+  File_t *file = mem_alloc(MEM_MISC, sizeof(File_t));
+  file->file_size = filesize;
+
+  // The bytes past the end of the file are zero up to the end of its last page.
+  // Empty files can't be mapped, reading them gives the empty string.
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size > 0 && filesize % (size_t)page_size != 0) {
+    void *mapped = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      close(fd);
+      file->file_contents = mapped;
+      file->mapped = true;
+      file->hash = hash_fnv1a(file->file_contents, filesize);
+      PRINT_TRACE("File '%s' mapped, size: %zu", filename, filesize);
+      return file;
+    }
+    PRINT_TRACE("mmap failed for '%s', reading it instead", filename);
+  }
+
+  // Read through the same descriptor, so the size is the one just checked
+  file->file_contents = fd_read(fd, filename, filesize);
+  close(fd);
+  if (file->file_contents == NULL) {
+    mem_free(MEM_MISC, file, sizeof(File_t));
+    return NULL;
+  }
+  file->hash = hash_fnv1a(file->file_contents, filesize);
+  PRINT_TRACE("File '%s' read, size: %zu", filename, filesize);
+
+  return file;
+}
+
+/* Releases a file from file_map_read */
+void file_unmap(File_t *file) {
+
+  if (file == NULL) {
+    return;
+  }
+
+  if (file->mapped) {
+    munmap(file->file_contents, file->file_size);
+  } else {
+    mem_free(MEM_SOURCE, file->file_contents, file->file_size + 1);
+  }
+
+  mem_free(MEM_MISC, file, sizeof(File_t));
+}
+
+/* 64 bit FNV-1a hash, used to key anything derived from a source file */
+uint64_t hash_fnv1a(const char *bytes, size_t len) {
+  return hash_fnv1a_update(14695981039346656037ULL, bytes, len);
+}
+
+/* Carries on a hash_fnv1a over more bytes, so pieces hash as if they were
+   one */
+uint64_t hash_fnv1a_update(uint64_t hash, const char *bytes, size_t len) {
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
@@ -0,0 +1,81 @@
+#include "include/writer.h"
+#include <string.h>
+
+void writer_init(Writer *writer, FILE *out) {
+  writer->out = out;
+  writer->len = 0;
+}
+
+void writer_flush(Writer *writer) {
+  if (writer->len > 0) {
+    fwrite(writer->buf, 1, writer->len, writer->out);
+    writer->len = 0;
+  }
+  fflush(writer->out);
+}
+
+void writer_write(Writer *writer, const char *bytes, size_t len) {
+  if (writer->len + len > WRITER_BUFFER_SIZE) {
+    fwrite(writer->buf, 1, writer->len, writer->out);
+    writer->len = 0;
+  }
+
+  // Too big to be worth copying
+  if (len > WRITER_BUFFER_SIZE) {
+    fwrite(bytes, 1, len, writer->out);
+    return;
+  }
+
+  memcpy(writer->buf + writer->len, bytes, len);
+  writer->len += len;
+}
+
+void writer_puts(Writer *writer, const char *str) {
+  writer_write(writer, str, strlen(str));
+}
+
+void writer_vprintf(Writer *writer, const char *format, va_list args) {
+  size_t room = WRITER_BUFFER_SIZE - writer->len;
+
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(writer->buf + writer->len, room, format, copy);
+  va_end(copy);
+
+  if (len < 0) {
+    return;
+  }
+  if ((size_t)len < room) {
+    writer->len += len;
+    return;
+  }
+
+  // Did not fit, so make room and try again
+  fwrite(writer->buf, 1, writer->len, writer->out);
+  writer->len = 0;
+
+  if ((size_t)len < WRITER_BUFFER_SIZE) {
+    vsnprintf(writer->buf, WRITER_BUFFER_SIZE, format, args);
+    writer->len = len;
+  } else {
+    vfprintf(writer->out, format, args);
+  }
+}
+
+void writer_printf(Writer *writer, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  writer_vprintf(writer, format, args);
+  va_end(args);
+}
+
+void writer_indent(Writer *writer, size_t levels) {
+  static const char spaces[] = "                                ";
+  size_t count = levels * 2;
+
+  while (count > 0) {
+    size_t chunk = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+    writer_write(writer, spaces, chunk);
+    count -= chunk;
+  }
+}